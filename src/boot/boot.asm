@@ -10,6 +10,11 @@ BITS 16
 CODE_SEG equ gdt_code - gdt_start
 DATA_SEG equ gdt_data - gdt_start
 
+; Where the E820 memory map is left for the kernel, must match OS_MEMORY_MAP_ADDRESS
+MEMORY_MAP_ADDRESS equ 0x0500
+MEMORY_MAP_MAX_ENTRIES equ 32
+E820_SIGNATURE equ 0x534D4150
+
 jmp short start
 nop
 
@@ -49,6 +54,30 @@ step2:
     mov sp, 0x7c00
     sti ; Enables Interrupts
 
+; Ask the BIOS for the memory map, a dword count followed by 24 byte entries
+.load_memory_map:
+    xor ebx, ebx
+    xor bp, bp
+    mov di, MEMORY_MAP_ADDRESS + 4
+.next_memory_map_entry:
+    mov eax, 0xE820
+    mov ecx, 24
+    mov edx, E820_SIGNATURE
+    mov dword [es:di + 20], 1 ; Mark the ACPI attributes valid for BIOSes that only fill 20 bytes
+    int 0x15
+    jc .memory_map_done
+    cmp eax, E820_SIGNATURE
+    jne .memory_map_done
+    inc bp
+    add di, 24
+    test ebx, ebx
+    jz .memory_map_done
+    cmp bp, MEMORY_MAP_MAX_ENTRIES
+    jb .next_memory_map_entry
+.memory_map_done:
+    movzx ebp, bp
+    mov [MEMORY_MAP_ADDRESS], ebp
+
 .load_protected:
     cli
     lgdt[gdt_descriptor]
@@ -90,9 +119,11 @@ gdt_descriptor:
  [BITS 32]
  load32:
     mov eax, 1
-    mov ecx, 100
+    ; The kernel may use every reserved sector between the boot sector and the FAT
+    mov ecx, 199
     mov edi, 0x0100000
     call ata_lba_read
+    mov ebx, MEMORY_MAP_ADDRESS ; The kernel passes this to kernel_main
     jmp CODE_SEG:0x0100000
 
 ata_lba_read:
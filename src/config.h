@@ -7,14 +7,83 @@
 
 #define OS_TOTAL_INTERRUPTS 512
 
-// 100MB heap size
+// E820 memory map left by the bootloader, must match MEMORY_MAP_ADDRESS in boot.asm
+#define OS_MEMORY_MAP_ADDRESS 0x00000500
+#define OS_MEMORY_MAP_MAX_ENTRIES 32
+
+// Usable memory between OS_HEAP_ADDRESS and this address is split between the heap and frame pool
+#define OS_MEMORY_MAX_ADDRESS 0xC0000000
+// Least usable memory above OS_HEAP_ADDRESS we boot with, the fixed layout below is only used without a map
+#define OS_MEMORY_MIN_BYTES 0x00C00000
+// Share of usable memory given to the frame pool, at least OS_FRAME_POOL_SIZE_BYTES
+#define OS_FRAME_POOL_PERCENT 25
+
+// 100MB heap size when there is no memory map
 #define OS_HEAP_SIZE_BYTES 104857600
 #define OS_HEAP_BLOCK_SIZE 4096
 #define OS_HEAP_ADDRESS 0x01000000 
-#define OS_HEAP_TABLE_ADDRESS 0x00007E00
+
+// Allocator backing the kernel heap, HEAP_TYPE_TABLE or HEAP_TYPE_BUDDY
+#define OS_HEAP_TYPE HEAP_TYPE_TABLE
+
+// Free heap blocks zeroed per idle loop iteration so kzalloc can skip the memset
+#define OS_HEAP_IDLE_ZERO_BLOCKS 16
+
+// Small allocations are served from power of two slab caches between these sizes. A 2048 byte
+// class would fit a single object next to the slab header, so those go to the heap instead
+#define OS_SLAB_MIN_SIZE 16
+#define OS_SLAB_MAX_SIZE 1024
+#define OS_SLAB_TOTAL_CLASSES 7
+
+// Free objects each processor keeps per slab class, refilled and drained half at a time
+#define OS_SLAB_MAGAZINE_SIZE 32
+
+#define OS_MAX_CPUS 8
+
+// Set to 1 to tag every kernel heap allocation with its call site
+#define OS_KHEAP_PROFILING 0
+#define OS_KHEAP_PROFILE_MAX_SITES 64
+#define OS_KHEAP_PROFILE_MAX_TRACKED 8192
+
+// Physical frames for page tables and DMA, kept apart from the heap. Used when there is no memory map
+#define OS_FRAME_POOL_ADDRESS 0x07400000
+#define OS_FRAME_POOL_SIZE_BYTES 0x00800000
+
+// Identity map the kernel with 4MB pages where the processor has PSE, tables are only created
+// where 4KB pages are needed
+#define OS_PAGING_LARGE_PAGES 1
+
+// Ranges longer than this many pages are flushed with one CR3 reload instead of invlpg per page
+#define OS_PAGING_INVLPG_THRESHOLD 32
+
+// Kernel virtual window that vmalloc maps scattered frames into
+#define OS_VMALLOC_START 0xC0000000
+#define OS_VMALLOC_SIZE_BYTES 0x10000000
+
+// Everything below this is kernel memory and mapped global, so it survives directory switches
+#define OS_PAGING_GLOBAL_END (OS_VMALLOC_START + OS_VMALLOC_SIZE_BYTES)
 
 #define OS_SECTOR_SIZE 512
 
+// Use bus master IDE DMA when a PCI IDE controller is found, PIO otherwise
+#define OS_DISK_USE_DMA 1
+
+// Upper limit on the sectors per interrupt negotiated with SET MULTIPLE for PIO reads
+#define OS_DISK_MAX_MULTIPLE 16
+
+// Sectors kept in the block cache, must be a power of two
+#define OS_DISK_CACHE_BLOCKS 256
+
+// Read-ahead window in sectors for sequential streams, doubled on every sequential sector up to the max
+#define OS_DISK_READAHEAD_MIN 4
+#define OS_DISK_READAHEAD_MAX 64
+
+// Largest command in sectors that the request queue builds by merging adjacent requests
+#define OS_DISK_QUEUE_MERGE_MAX 128
+
+// Disks the kernel keeps track of, ids are handed out in the order drivers find them
+#define OS_MAX_DISKS 8
+
 #define OS_MAX_FILESYSTEMS 12
 #define OS_MAX_FILE_DESCRIPTORS 512
 
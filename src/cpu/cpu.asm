@@ -0,0 +1,96 @@
+section .asm
+
+global spin_lock
+global spin_unlock
+global cpu_cpuid
+global cpu_halt_until_interrupt
+global cpu_save_interrupts
+global cpu_restore_interrupts
+global cpu_read_msr
+global cpu_write_msr
+
+spin_lock:
+    push ebp
+    mov ebp,esp
+    mov edx,[ebp+8]
+.try_again:
+    mov eax,1
+    xchg eax,[edx]
+    test eax,eax
+    jz .locked
+.wait:
+    pause
+    cmp dword [edx],0
+    jne .wait
+    jmp .try_again
+.locked:
+    pop ebp
+    ret
+
+spin_unlock:
+    push ebp
+    mov ebp,esp
+    mov edx,[ebp+8]
+    mov dword [edx],0
+    pop ebp
+    ret
+
+; Interrupts are only taken once hlt has started, so one raised after a check made with
+; interrupts disabled still wakes us up
+cpu_halt_until_interrupt:
+    sti
+    hlt
+    ret
+
+; Returns EFLAGS from before interrupts were disabled
+cpu_save_interrupts:
+    pushfd
+    pop eax
+    cli
+    ret
+
+cpu_restore_interrupts:
+    push dword [esp+4]
+    popfd
+    ret
+
+; void cpu_cpuid(uint32_t leaf, struct cpu_registers* out)
+cpu_cpuid:
+    push ebp
+    mov ebp,esp
+    push ebx
+    push edi
+    mov eax,[ebp+8]
+    xor ecx,ecx
+    cpuid
+    mov edi,[ebp+12]
+    mov [edi],eax
+    mov [edi+4],ebx
+    mov [edi+8],ecx
+    mov [edi+12],edx
+    pop edi
+    pop ebx
+    pop ebp
+    ret
+
+; uint32_t cpu_read_msr(uint32_t msr, uint32_t* high)
+cpu_read_msr:
+    push ebp
+    mov ebp,esp
+    mov ecx,[ebp+8]
+    rdmsr
+    mov ecx,[ebp+12]
+    mov [ecx],edx
+    pop ebp
+    ret
+
+; void cpu_write_msr(uint32_t msr, uint32_t low, uint32_t high)
+cpu_write_msr:
+    push ebp
+    mov ebp,esp
+    mov ecx,[ebp+8]
+    mov eax,[ebp+12]
+    mov edx,[ebp+16]
+    wrmsr
+    pop ebp
+    ret
@@ -0,0 +1,39 @@
+#include "cpu.h"
+#include "config.h"
+
+/**
+ * Index of the processor we are running on, between 0 and OS_MAX_CPUS - 1.
+ * Only the bootstrap processor runs the kernel for now, application processors
+ * will report their own index here once they are brought up.
+ */
+int cpu_current_id()
+{
+    return 0;
+}
+
+/**
+ * Whether the processor reports one of the CPU_FEATURE_EDX_* bits in CPUID leaf 1
+ */
+bool cpu_has_feature(uint32_t edx_feature)
+{
+    struct cpu_registers registers;
+    cpu_cpuid(1, &registers);
+    return (registers.edx & edx_feature) != 0;
+}
+
+/**
+ * Takes the lock with interrupts disabled on this processor, for locks that are
+ * also taken from interrupt handlers. Returns the flags to give back on unlock.
+ */
+uint32_t spin_lock_irqsave(SPINLOCK* lock)
+{
+    uint32_t flags = cpu_save_interrupts();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(SPINLOCK* lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    cpu_restore_interrupts(flags);
+}
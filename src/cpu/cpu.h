@@ -0,0 +1,42 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// CPUID leaf 1 EDX feature bits
+#define CPU_FEATURE_EDX_PSE 0x00000008
+#define CPU_FEATURE_EDX_PGE 0x00002000
+#define CPU_FEATURE_EDX_PAT 0x00010000
+
+#define CPU_MSR_PAT 0x277
+
+// Interrupt enable bit in the flags cpu_save_interrupts returns
+#define CPU_FLAGS_IF 0x00000200
+
+typedef volatile uint32_t SPINLOCK;
+
+struct cpu_registers
+{
+    uint32_t eax;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+};
+
+int cpu_current_id();
+void cpu_halt_until_interrupt();
+uint32_t cpu_save_interrupts();
+void cpu_restore_interrupts(uint32_t flags);
+
+void cpu_cpuid(uint32_t leaf, struct cpu_registers* out);
+bool cpu_has_feature(uint32_t edx_feature);
+uint32_t cpu_read_msr(uint32_t msr, uint32_t* high);
+void cpu_write_msr(uint32_t msr, uint32_t low, uint32_t high);
+
+void spin_lock(SPINLOCK* lock);
+void spin_unlock(SPINLOCK* lock);
+uint32_t spin_lock_irqsave(SPINLOCK* lock);
+void spin_unlock_irqrestore(SPINLOCK* lock, uint32_t flags);
+
+#endif
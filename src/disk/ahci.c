@@ -0,0 +1,740 @@
+#include "ahci.h"
+#include "disk.h"
+#include "atacmd.h"
+#include "queue.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "idt/idt.h"
+#include "cpu/cpu.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/paging/paging.h"
+
+// The AHCI programming interface of the SATA subclass
+#define AHCI_PROG_IF 0x01
+
+// Generic host control, the ports follow at 0x100 with 0x80 bytes each
+#define AHCI_ABAR_BAR  5
+#define AHCI_ABAR_SIZE 0x2000
+
+// Registers are indexed in dwords
+#define AHCI_HBA_CAP 0x00
+#define AHCI_HBA_GHC 0x01
+#define AHCI_HBA_IS  0x02
+#define AHCI_HBA_PI  0x03
+#define AHCI_HBA_PORTS 0x40
+#define AHCI_HBA_PORT_SIZE 0x20
+
+#define AHCI_CAP_NCS_SHIFT 8
+#define AHCI_CAP_NCS_MASK  0x1f
+#define AHCI_CAP_SNCQ      0x40000000
+
+#define AHCI_GHC_IE 0x00000002
+#define AHCI_GHC_AE 0x80000000
+
+#define AHCI_PORT_CLB  0x00
+#define AHCI_PORT_CLBU 0x01
+#define AHCI_PORT_FB   0x02
+#define AHCI_PORT_FBU  0x03
+#define AHCI_PORT_IS   0x04
+#define AHCI_PORT_IE   0x05
+#define AHCI_PORT_CMD  0x06
+#define AHCI_PORT_TFD  0x08
+#define AHCI_PORT_SIG  0x09
+#define AHCI_PORT_SSTS 0x0A
+#define AHCI_PORT_SERR 0x0C
+#define AHCI_PORT_SACT 0x0D
+#define AHCI_PORT_CI   0x0E
+
+#define AHCI_PORT_CMD_ST  0x0001
+#define AHCI_PORT_CMD_FRE 0x0010
+#define AHCI_PORT_CMD_FR  0x4000
+#define AHCI_PORT_CMD_CR  0x8000
+
+// Device to host register FIS, set device bits FIS for NCQ completions, and task file errors
+#define AHCI_PORT_IS_DHRS 0x00000001
+#define AHCI_PORT_IS_SDBS 0x00000008
+#define AHCI_PORT_IS_TFES 0x40000000
+#define AHCI_PORT_IE_DEFAULT (AHCI_PORT_IS_DHRS | AHCI_PORT_IS_SDBS | AHCI_PORT_IS_TFES)
+
+// A device is present with the PHY up, and the interface is active
+#define AHCI_SSTS_DET_MASK    0x0f
+#define AHCI_SSTS_DET_PRESENT 0x03
+#define AHCI_SSTS_IPM_MASK    0xf00
+#define AHCI_SSTS_IPM_ACTIVE  0x100
+
+#define AHCI_SIG_ATA 0x00000101
+
+#define AHCI_FIS_TYPE_H2D 0x27
+#define AHCI_FIS_COMMAND  0x80
+#define AHCI_FIS_DEVICE_LBA 0x40
+
+// The received FIS area follows the 1KB command list in the port's frame
+#define AHCI_FIS_OFFSET 1024
+
+#define AHCI_PRD_INTERRUPT 0x80000000
+
+// An entry holds at most 4MB
+#define AHCI_PRD_BOUNDARY 0x400000
+
+// Iterations to wait for the HBA while setting it up, before interrupts are used
+#define AHCI_SPIN_TIMEOUT 1000000
+
+struct ahci_hba
+{
+    volatile uint32_t* registers;
+    struct ahci_port* ports[AHCI_MAX_PORTS];
+
+    // Without an IRQ line of our own, completions are found by polling from the idle loop and waiting reads
+    bool polled;
+};
+
+static struct ahci_hba ahci_hba;
+
+static uint32_t ahci_port_read(struct ahci_port* port, int reg)
+{
+    return port->registers[reg];
+}
+
+static void ahci_port_write(struct ahci_port* port, int reg, uint32_t val)
+{
+    port->registers[reg] = val;
+}
+
+static bool ahci_port_wait_clear(struct ahci_port* port, int reg, uint32_t bits)
+{
+    for (int i = 0; i < AHCI_SPIN_TIMEOUT; i++)
+    {
+        if (!(ahci_port_read(port, reg) & bits))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int ahci_port_stop(struct ahci_port* port)
+{
+    ahci_port_write(port, AHCI_PORT_CMD, ahci_port_read(port, AHCI_PORT_CMD) & ~AHCI_PORT_CMD_ST);
+    if (!ahci_port_wait_clear(port, AHCI_PORT_CMD, AHCI_PORT_CMD_CR))
+    {
+        return -EIO;
+    }
+
+    ahci_port_write(port, AHCI_PORT_CMD, ahci_port_read(port, AHCI_PORT_CMD) & ~AHCI_PORT_CMD_FRE);
+    if (!ahci_port_wait_clear(port, AHCI_PORT_CMD, AHCI_PORT_CMD_FR))
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static int ahci_port_start(struct ahci_port* port)
+{
+    // Stale errors would stop the new commands straight away
+    ahci_port_write(port, AHCI_PORT_SERR, 0xffffffff);
+    ahci_port_write(port, AHCI_PORT_IS, 0xffffffff);
+
+    ahci_port_write(port, AHCI_PORT_CMD, ahci_port_read(port, AHCI_PORT_CMD) | AHCI_PORT_CMD_FRE);
+    if (!ahci_port_wait_clear(port, AHCI_PORT_TFD, ATA_STATUS_BSY | ATA_STATUS_DRQ))
+    {
+        return -EIO;
+    }
+
+    ahci_port_write(port, AHCI_PORT_CMD, ahci_port_read(port, AHCI_PORT_CMD) | AHCI_PORT_CMD_ST);
+    return 0;
+}
+
+/**
+ * Fills the slot's PRD table with one entry per physically contiguous run of buf, and returns the
+ * number of entries
+ */
+static int ahci_build_prdt(struct ahci_command_table* table, void* buf, uint32_t bytes)
+{
+    struct ata_dma_walk walk;
+    int res = ata_dma_walk_init(&walk, buf, bytes);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    int total = 0;
+    uint32_t phys = 0;
+    uint32_t length = 0;
+    while ((res = ata_dma_walk_next(&walk, AHCI_PRD_BOUNDARY, &phys, &length)) > 0)
+    {
+        if (total == AHCI_PRDT_ENTRIES)
+        {
+            return -EINVARG;
+        }
+
+        // The count is stored minus one
+        table->prdt[total].address = phys;
+        table->prdt[total].address_high = 0;
+        table->prdt[total].reserved = 0;
+        table->prdt[total].bytes = length - 1;
+        total++;
+    }
+
+    if (res < 0)
+    {
+        return res;
+    }
+
+    table->prdt[total - 1].bytes |= AHCI_PRD_INTERRUPT;
+    return total;
+}
+
+static void ahci_build_fis(struct ahci_fis_h2d* fis, int slot, unsigned char command, unsigned int lba, int total)
+{
+    memset(fis, 0, sizeof(struct ahci_fis_h2d));
+    fis->type = AHCI_FIS_TYPE_H2D;
+    fis->flags = AHCI_FIS_COMMAND;
+    fis->command = command;
+    fis->device = AHCI_FIS_DEVICE_LBA;
+    fis->lba0 = (uint8_t)(lba & 0xff);
+    fis->lba1 = (uint8_t)(lba >> 8);
+    fis->lba2 = (uint8_t)(lba >> 16);
+    fis->lba3 = (uint8_t)(lba >> 24);
+
+    if (command == ATA_COMMAND_READ_FPDMA_QUEUED)
+    {
+        // NCQ moves the sector count into the features and the tag into the count
+        fis->feature_low = (uint8_t)(total & 0xff);
+        fis->feature_high = (uint8_t)(total >> 8);
+        fis->count_low = (uint8_t)(slot << 3);
+        return;
+    }
+
+    if (command == ATA_COMMAND_READ_DMA)
+    {
+        // LBA28 keeps the top four bits of the address in the device register
+        fis->device |= (lba >> 24) & 0x0f;
+        fis->lba3 = 0;
+    }
+
+    fis->count_low = (uint8_t)(total & 0xff);
+    fis->count_high = (uint8_t)(total >> 8);
+}
+
+/**
+ * Points the slot's command header and table at a command, the caller sets it going
+ */
+static int ahci_port_prepare(struct ahci_port* port, int slot, unsigned char command, unsigned int lba, int total, void* buf, uint32_t bytes)
+{
+    struct ahci_command_table* table = port->tables[slot];
+    int entries = ahci_build_prdt(table, buf, bytes);
+    if (entries < 0)
+    {
+        return entries;
+    }
+
+    ahci_build_fis((struct ahci_fis_h2d*) table->fis, slot, command, lba, total);
+
+    struct ahci_command_header* header = &port->command_list[slot];
+    header->flags = sizeof(struct ahci_fis_h2d) / sizeof(uint32_t);
+    header->prdt_length = entries;
+    header->bytes = 0;
+    return 0;
+}
+
+static int ahci_port_free_slot(struct ahci_port* port)
+{
+    for (int i = 0; i < port->depth; i++)
+    {
+        if (!(port->busy & (1u << i)))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Hands one command of a request to the HBA in the given slot. Must be called with interrupts disabled
+ */
+static int ahci_port_issue(struct ahci_port* port, int slot, struct disk_request* request, unsigned int lba, int total, void* buf)
+{
+    unsigned char command = ATA_COMMAND_READ_DMA;
+    if (port->ncq)
+    {
+        command = ATA_COMMAND_READ_FPDMA_QUEUED;
+    }
+    else if (port->lba48 || lba + total > ATA_LBA28_MAX_LBA)
+    {
+        command = ATA_COMMAND_READ_DMA_EXT;
+    }
+
+    int res = ahci_port_prepare(port, slot, command, lba, total, buf, total * OS_SECTOR_SIZE);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    port->requests[slot] = request;
+    port->busy |= 1u << slot;
+
+    // Queued commands are marked active before they are issued
+    if (port->ncq)
+    {
+        ahci_port_write(port, AHCI_PORT_SACT, 1u << slot);
+    }
+    ahci_port_write(port, AHCI_PORT_CI, 1u << slot);
+    return 0;
+}
+
+/**
+ * A request is done once none of its commands are waiting to be issued or still in a slot
+ */
+static bool ahci_port_in_flight(struct ahci_port* port, struct disk_request* request)
+{
+    if (port->waiting == request)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < port->slots; i++)
+    {
+        if (port->requests[i] == request)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void ahci_finish(struct ahci_port* port, struct disk_request* request, int res)
+{
+    // The first failed command decides the result of the whole request
+    if (res < 0 && request->res == 0)
+    {
+        request->res = res;
+    }
+
+    if (!ahci_port_in_flight(port, request) && request->callback)
+    {
+        request->callback(request, request->res);
+    }
+}
+
+static void ahci_port_retire(struct ahci_port* port, int slot, int res)
+{
+    struct disk_request* request = port->requests[slot];
+    port->requests[slot] = 0;
+    ahci_finish(port, request, res);
+}
+
+/**
+ * Issues waiting requests into free slots, each split into commands of at most AHCI_MAX_SECTORS.
+ * Must be called with interrupts disabled
+ */
+static void ahci_port_dispatch(struct ahci_port* port)
+{
+    int slot = 0;
+    while (port->waiting && (slot = ahci_port_free_slot(port)) >= 0)
+    {
+        struct disk_request* request = port->waiting;
+        int offset = port->waiting_issued;
+        int count = request->total - offset;
+        if (count > AHCI_MAX_SECTORS)
+        {
+            count = AHCI_MAX_SECTORS;
+        }
+
+        int res = ahci_port_issue(port, slot, request, request->lba + offset, count, request->buf + (offset * OS_SECTOR_SIZE));
+
+        // A command that can not be built fails the rest of the request too
+        port->waiting_issued += count;
+        if (res < 0 || port->waiting_issued == request->total)
+        {
+            port->waiting = request->next;
+            port->waiting_issued = 0;
+            request->next = 0;
+        }
+
+        if (res < 0)
+        {
+            ahci_finish(port, request, res);
+        }
+    }
+}
+
+/**
+ * A failed command stops the port. Every command in flight is failed, since the device drops its
+ * whole queue on an error, and the port is restarted for the requests that come after
+ */
+static void ahci_port_recover(struct ahci_port* port)
+{
+    uint32_t failed = port->busy;
+    port->busy = 0;
+
+    ahci_port_stop(port);
+    ahci_port_start(port);
+
+    for (int i = 0; i < port->slots; i++)
+    {
+        if (failed & (1u << i))
+        {
+            ahci_port_retire(port, i, -EIO);
+        }
+    }
+}
+
+/**
+ * Completes every slot the HBA is done with and moves waiting requests into the freed slots.
+ * Runs from the IRQ, or from ahci_poll when there is no IRQ, with interrupts disabled
+ */
+static void ahci_port_complete(struct ahci_port* port)
+{
+    uint32_t status = ahci_port_read(port, AHCI_PORT_IS);
+    ahci_port_write(port, AHCI_PORT_IS, status);
+    if (status & AHCI_PORT_IS_TFES)
+    {
+        ahci_port_recover(port);
+    }
+    else
+    {
+        // An NCQ command stays active until the device reports it with a set device bits FIS
+        uint32_t active = ahci_port_read(port, AHCI_PORT_SACT) | ahci_port_read(port, AHCI_PORT_CI);
+        uint32_t done = port->busy & ~active;
+        port->busy &= ~done;
+        for (int i = 0; i < port->slots; i++)
+        {
+            if (done & (1u << i))
+            {
+                ahci_port_retire(port, i, 0);
+            }
+        }
+    }
+
+    ahci_port_dispatch(port);
+}
+
+static void ahci_interrupt_handler(int irq)
+{
+    // Ports are acknowledged before the HBA, or the line would stay raised
+    uint32_t pending = ahci_hba.registers[AHCI_HBA_IS];
+    for (int i = 0; i < AHCI_MAX_PORTS; i++)
+    {
+        if ((pending & (1u << i)) && ahci_hba.ports[i])
+        {
+            ahci_port_complete(ahci_hba.ports[i]);
+        }
+    }
+    ahci_hba.registers[AHCI_HBA_IS] = pending;
+}
+
+/**
+ * Queues a read of any length, the driver splits it into as many commands as it needs and calls
+ * the callback once all of them are done
+ */
+static int ahci_submit(struct disk* idisk, struct disk_request* request)
+{
+    struct ahci_port* port = idisk->driver_private;
+    if (request->type != DISK_REQUEST_READ || request->total <= 0 || ((uint32_t) request->buf & 0x01))
+    {
+        return -EINVARG;
+    }
+
+    uint32_t flags = cpu_save_interrupts();
+    request->next = 0;
+    request->res = 0;
+    if (port->waiting)
+    {
+        port->waiting_tail->next = request;
+    }
+    else
+    {
+        port->waiting = request;
+    }
+    port->waiting_tail = request;
+
+    ahci_port_dispatch(port);
+    cpu_restore_interrupts(flags);
+
+    return 0;
+}
+
+/**
+ * Checks the port for completed commands, called from the idle loop and by reads waiting with
+ * the HBA's IRQ unavailable or interrupts disabled
+ */
+static void ahci_poll(struct disk* idisk)
+{
+    uint32_t flags = cpu_save_interrupts();
+    ahci_port_complete(idisk->driver_private);
+    cpu_restore_interrupts(flags);
+}
+
+static void ahci_read_done(struct disk_request* request, int res)
+{
+    *(volatile bool*) request->private = true;
+}
+
+static int ahci_read(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    volatile bool done = false;
+    struct disk_request request;
+    memset(&request, 0, sizeof(request));
+    request.type = DISK_REQUEST_READ;
+    request.disk = idisk;
+    request.lba = lba;
+    request.total = total;
+    request.buf = buf;
+    request.callback = ahci_read_done;
+    request.private = (void*) &done;
+
+    uint32_t flags = cpu_save_interrupts();
+    int res = ahci_submit(idisk, &request);
+    if (res < 0)
+    {
+        cpu_restore_interrupts(flags);
+        return res;
+    }
+
+    // Without the HBA's IRQ, or with the caller's interrupts off, completions are polled for
+    while (!done)
+    {
+        if (ahci_hba.polled || !(flags & CPU_FLAGS_IF))
+        {
+            ahci_port_complete(idisk->driver_private);
+            continue;
+        }
+
+        cpu_halt_until_interrupt();
+        disable_interrupts();
+    }
+    cpu_restore_interrupts(flags);
+
+    return request.res;
+}
+
+static struct disk_driver ahci_driver = {
+    .name = "AHCI",
+    .read = ahci_read,
+    .submit = ahci_submit,
+    .poll = ahci_poll
+};
+
+/**
+ * Sends IDENTIFY through slot 0 and polls for it, used before the port's interrupts are enabled
+ */
+static int ahci_port_identify(struct ahci_port* port, uint16_t* identify)
+{
+    int res = ahci_port_prepare(port, 0, ATA_COMMAND_IDENTIFY, 0, 0, identify, OS_SECTOR_SIZE);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    ahci_port_write(port, AHCI_PORT_CI, 1);
+    for (int i = 0; i < AHCI_SPIN_TIMEOUT; i++)
+    {
+        if (ahci_port_read(port, AHCI_PORT_IS) & AHCI_PORT_IS_TFES)
+        {
+            break;
+        }
+
+        if (!(ahci_port_read(port, AHCI_PORT_CI) & 1))
+        {
+            ahci_port_write(port, AHCI_PORT_IS, 0xffffffff);
+            return 0;
+        }
+    }
+
+    ahci_port_stop(port);
+    ahci_port_start(port);
+    return -EIO;
+}
+
+/**
+ * Gives the port its command list, received FIS area and one command table per slot. The command
+ * list and FIS share a frame and the tables are packed into frames, all identity mapped
+ */
+static int ahci_port_alloc(struct ahci_port* port)
+{
+    char* frame = frame_alloc();
+    if (!frame)
+    {
+        return -ENOMEM;
+    }
+    memset(frame, 0, FRAME_SIZE);
+    port->command_list = (struct ahci_command_header*) frame;
+    port->fis = frame + AHCI_FIS_OFFSET;
+
+    int per_frame = FRAME_SIZE / sizeof(struct ahci_command_table);
+    for (int i = 0; i < port->slots; i += per_frame)
+    {
+        struct ahci_command_table* tables = frame_alloc();
+        if (!tables)
+        {
+            return -ENOMEM;
+        }
+        memset(tables, 0, FRAME_SIZE);
+
+        for (int b = 0; b < per_frame && i + b < port->slots; b++)
+        {
+            port->tables[i + b] = &tables[b];
+            port->command_list[i + b].table = (uint32_t) &tables[b];
+        }
+    }
+
+    return 0;
+}
+
+static void ahci_port_free(struct ahci_port* port)
+{
+    int per_frame = FRAME_SIZE / sizeof(struct ahci_command_table);
+    for (int i = 0; i < port->slots; i += per_frame)
+    {
+        if (port->tables[i])
+        {
+            frame_free(port->tables[i]);
+        }
+    }
+
+    if (port->command_list)
+    {
+        frame_free(port->command_list);
+    }
+    kfree(port);
+}
+
+static int ahci_port_identify_disk(struct ahci_port* port, struct disk* idisk, bool hba_ncq)
+{
+    uint16_t identify[256];
+    int res = ahci_port_identify(port, identify);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    port->lba48 = ata_identify_lba48(identify);
+    idisk->sectors = ata_identify_sectors(identify);
+
+    // Queue as deep as both the HBA and the device allow, one command at a time without NCQ
+    port->ncq = hba_ncq && port->lba48 && (identify[ATA_IDENTIFY_SATA_CAPABILITIES] & ATA_IDENTIFY_NCQ_SUPPORTED);
+    port->depth = 1;
+    if (port->ncq)
+    {
+        int device_depth = (identify[ATA_IDENTIFY_QUEUE_DEPTH] & 0x1f) + 1;
+        port->depth = device_depth < port->slots ? device_depth : port->slots;
+    }
+
+    return 0;
+}
+
+static void ahci_probe(int index, int slots, bool hba_ncq)
+{
+    volatile uint32_t* registers = ahci_hba.registers + AHCI_HBA_PORTS + (index * AHCI_HBA_PORT_SIZE);
+    uint32_t ssts = registers[AHCI_PORT_SSTS];
+    if ((ssts & AHCI_SSTS_DET_MASK) != AHCI_SSTS_DET_PRESENT ||
+        (ssts & AHCI_SSTS_IPM_MASK) != AHCI_SSTS_IPM_ACTIVE ||
+        registers[AHCI_PORT_SIG] != AHCI_SIG_ATA)
+    {
+        return;
+    }
+
+    struct ahci_port* port = kzalloc(sizeof(struct ahci_port));
+    struct disk* idisk = kzalloc(sizeof(struct disk));
+    if (!port || !idisk)
+    {
+        kfree(port);
+        kfree(idisk);
+        return;
+    }
+
+    port->registers = registers;
+    port->index = index;
+    port->slots = slots;
+    if (ahci_port_stop(port) < 0 || ahci_port_alloc(port) < 0)
+    {
+        goto out_free;
+    }
+
+    ahci_port_write(port, AHCI_PORT_CLB, (uint32_t) port->command_list);
+    ahci_port_write(port, AHCI_PORT_CLBU, 0);
+    ahci_port_write(port, AHCI_PORT_FB, (uint32_t) port->fis);
+    ahci_port_write(port, AHCI_PORT_FBU, 0);
+    ahci_port_write(port, AHCI_PORT_IE, 0);
+    if (ahci_port_start(port) < 0 || ahci_port_identify_disk(port, idisk, hba_ncq) < 0)
+    {
+        ahci_port_stop(port);
+        goto out_free;
+    }
+
+    idisk->type = PEACHOS_DISK_TYPE_REAL;
+    idisk->sector_size = OS_SECTOR_SIZE;
+    idisk->driver = &ahci_driver;
+    idisk->driver_private = port;
+    if (disk_register(idisk) < 0)
+    {
+        ahci_port_stop(port);
+        goto out_free;
+    }
+
+    ahci_hba.ports[index] = port;
+    return;
+
+out_free:
+    ahci_port_free(port);
+    kfree(idisk);
+}
+
+/**
+ * Finds the first AHCI controller and registers a disk for every SATA drive on its ports. The HBA
+ * interrupts on the PCI line the firmware routed for it, or is polled when that line is taken
+ */
+void ahci_init()
+{
+    struct pci_device controller;
+    if (pci_find_device(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_SATA, &controller) < 0 || controller.prog_if != AHCI_PROG_IF)
+    {
+        return;
+    }
+
+    uint32_t abar = pci_device_read_bar(&controller, AHCI_ABAR_BAR) & 0xfffff000;
+    if (abar == 0 || paging_map_uncached(paging_current_directory(), (void*) abar, (void*) abar, AHCI_ABAR_SIZE) < 0)
+    {
+        return;
+    }
+
+    pci_device_enable(&controller, PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER);
+    ahci_hba.registers = (volatile uint32_t*) abar;
+    ahci_hba.registers[AHCI_HBA_GHC] |= AHCI_GHC_AE;
+
+    uint32_t cap = ahci_hba.registers[AHCI_HBA_CAP];
+    int slots = ((cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1;
+    uint32_t implemented = ahci_hba.registers[AHCI_HBA_PI];
+    for (int i = 0; i < AHCI_MAX_PORTS; i++)
+    {
+        if (implemented & (1u << i))
+        {
+            ahci_probe(i, slots, cap & AHCI_CAP_SNCQ);
+        }
+    }
+
+    int irq = pci_config_read(controller.bus, controller.slot, controller.function, PCI_CONFIG_INTERRUPT) & 0xff;
+    ahci_hba.polled = idt_register_irq(irq, ahci_interrupt_handler) < 0;
+    if (ahci_hba.polled)
+    {
+        return;
+    }
+
+    for (int i = 0; i < AHCI_MAX_PORTS; i++)
+    {
+        if (ahci_hba.ports[i])
+        {
+            ahci_port_write(ahci_hba.ports[i], AHCI_PORT_IE, AHCI_PORT_IE_DEFAULT);
+        }
+    }
+    ahci_hba.registers[AHCI_HBA_IS] = 0xffffffff;
+    ahci_hba.registers[AHCI_HBA_GHC] |= AHCI_GHC_IE;
+}
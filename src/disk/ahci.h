@@ -0,0 +1,112 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AHCI_MAX_PORTS 32
+#define AHCI_MAX_COMMAND_SLOTS 32
+
+// Scatter gather entries per command table, sized so a table takes exactly 1KB
+#define AHCI_PRDT_ENTRIES 56
+
+// Sectors moved by one command, a buffer this big needs at most 33 PRD entries
+#define AHCI_MAX_SECTORS 256
+
+struct disk_request;
+
+// Register host to device FIS that carries an ATA command
+struct ahci_fis_h2d
+{
+    uint8_t type;
+
+    // Bit 7 tells the device this is a new command
+    uint8_t flags;
+    uint8_t command;
+    uint8_t feature_low;
+
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+
+    uint8_t reserved[4];
+} __attribute__((packed));
+
+// One entry of a port's command list, points the HBA at the command table of its slot
+struct ahci_command_header
+{
+    // Command FIS length in dwords in the low bits, bit 6 set for writes
+    uint16_t flags;
+    uint16_t prdt_length;
+
+    // Bytes transferred, updated by the HBA
+    volatile uint32_t bytes;
+
+    uint32_t table;
+    uint32_t table_high;
+    uint32_t reserved[4];
+} __attribute__((packed));
+
+struct ahci_prd
+{
+    uint32_t address;
+    uint32_t address_high;
+    uint32_t reserved;
+
+    // Byte count minus one in bits 0 to 21, bit 31 asks for an interrupt
+    uint32_t bytes;
+} __attribute__((packed));
+
+struct ahci_command_table
+{
+    uint8_t fis[64];
+    uint8_t atapi[16];
+    uint8_t reserved[48];
+    struct ahci_prd prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed));
+
+struct ahci_port
+{
+    // Registers of this port inside the HBA's memory
+    volatile uint32_t* registers;
+    int index;
+
+    // 32 command headers followed by the received FIS area, all in one frame
+    struct ahci_command_header* command_list;
+    void* fis;
+    struct ahci_command_table* tables[AHCI_MAX_COMMAND_SLOTS];
+
+    // Slots the HBA implements, and how many of them we keep busy at once
+    int slots;
+    int depth;
+
+    // What IDENTIFY told us about the device
+    bool lba48;
+    bool ncq;
+
+    // Slots issued to the HBA that have not completed, and the request each one serves
+    uint32_t busy;
+    struct disk_request* requests[AHCI_MAX_COMMAND_SLOTS];
+
+    // Requests with commands still to issue, in the order they were submitted
+    struct disk_request* waiting;
+    struct disk_request* waiting_tail;
+
+    // Sectors of the first waiting request that are already in slots
+    int waiting_issued;
+};
+
+void ahci_init();
+
+#endif
@@ -0,0 +1,537 @@
+#include "ata.h"
+#include "disk.h"
+#include "atacmd.h"
+#include "io/io.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "idt/idt.h"
+#include "cpu/cpu.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+
+// Registers relative to a channel's command block base
+#define ATA_REG_DATA    0x00
+#define ATA_REG_COUNT   0x02
+#define ATA_REG_LBA0    0x03
+#define ATA_REG_LBA1    0x04
+#define ATA_REG_LBA2    0x05
+#define ATA_REG_DEVICE  0x06
+#define ATA_REG_COMMAND 0x07
+#define ATA_REG_STATUS  0x07
+
+// Highest sector count of one command, LBA48 is held back so a transfer fits in the PRD table
+#define ATA_LBA28_MAX_SECTORS 256
+#define ATA_LBA48_MAX_SECTORS 2048
+
+// Bus master IDE registers, relative to the channel's part of BAR4
+#define ATA_BM_COMMAND 0x00
+#define ATA_BM_STATUS  0x02
+#define ATA_BM_PRDT    0x04
+
+#define ATA_BM_COMMAND_START 0x01
+#define ATA_BM_COMMAND_READ  0x08
+#define ATA_BM_STATUS_ERR    0x02
+#define ATA_BM_STATUS_IRQ    0x04
+
+// Set on the last entry of a PRD table
+#define ATA_PRD_END 0x8000
+#define ATA_PRD_MAX_ENTRIES (FRAME_SIZE / sizeof(struct ata_prd))
+
+// An entry may not cross a 64KB boundary
+#define ATA_PRD_BOUNDARY 0x10000
+
+// Legacy ports, each channel starts out done so an interrupt nobody asked for is ignored
+static struct ata_channel ata_channels[ATA_TOTAL_CHANNELS] = {
+    { .base = 0x1F0, .control = 0x3F6, .current = { .done = true } },
+    { .base = 0x170, .control = 0x376, .current = { .done = true } }
+};
+
+static int ata_start_next(struct ata_channel* channel);
+
+/**
+ * Finds the IDE controller and gives each channel its half of the bus master registers in BAR4
+ */
+static void ata_dma_init()
+{
+    if (!OS_DISK_USE_DMA)
+    {
+        return;
+    }
+
+    struct pci_device controller;
+    if (pci_find_device(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_IDE, &controller) < 0)
+    {
+        return;
+    }
+
+    // Bus mastering is only usable when BAR4 is an I/O range
+    uint32_t bar = pci_device_read_bar(&controller, 4);
+    if (!(bar & 0x01) || (bar & 0xfffc) == 0)
+    {
+        return;
+    }
+
+    pci_device_enable(&controller, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    for (int i = 0; i < ATA_TOTAL_CHANNELS; i++)
+    {
+        ata_channels[i].prdt = frame_alloc();
+        if (ata_channels[i].prdt)
+        {
+            ata_channels[i].bm_base = (bar & 0xfffc) + (i * 8);
+        }
+    }
+}
+
+/**
+ * Describes buf to the controller, one entry per physically contiguous run inside a 64KB window
+ */
+static int ata_dma_build_prdt(struct ata_channel* channel, void* buf, uint32_t bytes)
+{
+    struct ata_dma_walk walk;
+    int res = ata_dma_walk_init(&walk, buf, bytes);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    uint32_t total = 0;
+    uint32_t phys = 0;
+    uint32_t length = 0;
+    while ((res = ata_dma_walk_next(&walk, ATA_PRD_BOUNDARY, &phys, &length)) > 0)
+    {
+        if (total == ATA_PRD_MAX_ENTRIES)
+        {
+            return -EINVARG;
+        }
+
+        // A full 64KB is stored as zero
+        channel->prdt[total].address = phys;
+        channel->prdt[total].bytes = length;
+        channel->prdt[total].flags = 0;
+        total++;
+    }
+
+    if (res < 0)
+    {
+        return res;
+    }
+
+    channel->prdt[total - 1].flags = ATA_PRD_END;
+    return 0;
+}
+
+/**
+ * Ends the channel's current command. A queued read moves on to its next command, or hands the
+ * result back to the request queue once all of it has been read
+ */
+static void ata_finish(struct ata_channel* channel, int res)
+{
+    struct ata_request* request = &channel->current;
+    request->res = res;
+    request->done = true;
+    if (!request->queued)
+    {
+        return;
+    }
+
+    if (res == 0 && request->left > 0)
+    {
+        res = ata_start_next(channel);
+        if (res == 0)
+        {
+            return;
+        }
+    }
+
+    request->queued = false;
+    disk_queue_complete(&channel->queue, res);
+}
+
+static void ata_dma_interrupt(struct ata_channel* channel, unsigned char status)
+{
+    unsigned char bm_status = insb(channel->bm_base + ATA_BM_STATUS);
+    if (!(bm_status & ATA_BM_STATUS_IRQ))
+    {
+        return;
+    }
+
+    // Stop the bus master and clear its interrupt and error bits by writing them back
+    outb(channel->bm_base + ATA_BM_COMMAND, 0x00);
+    outb(channel->bm_base + ATA_BM_STATUS, ATA_BM_STATUS_ERR | ATA_BM_STATUS_IRQ);
+    ata_finish(channel, (bm_status & ATA_BM_STATUS_ERR) || (status & ATA_STATUS_ERR) ? -EIO : 0);
+}
+
+void ata_interrupt_handler(int index)
+{
+    struct ata_channel* channel = &ata_channels[index];
+    struct ata_request* request = &channel->current;
+
+    // Reading the status register acknowledges the interrupt
+    unsigned char status = insb(channel->base + ATA_REG_STATUS);
+    if (request->done)
+    {
+        return;
+    }
+
+    if (request->dma)
+    {
+        ata_dma_interrupt(channel, status);
+        return;
+    }
+
+    if (status & ATA_STATUS_ERR)
+    {
+        ata_finish(channel, -EIO);
+        return;
+    }
+
+    // Commands without data complete with their first interrupt
+    if (request->remaining == 0)
+    {
+        ata_finish(channel, 0);
+        return;
+    }
+
+    if (!(status & ATA_STATUS_DRQ))
+    {
+        return;
+    }
+
+    // Copy from hard disk to memory, READ MULTIPLE raises DRQ once per block of sectors
+    int sectors = request->remaining < request->block ? request->remaining : request->block;
+    insw_rep(channel->base + ATA_REG_DATA, request->buf, sectors * (OS_SECTOR_SIZE / 2));
+    request->buf += sectors * (OS_SECTOR_SIZE / 2);
+
+    request->remaining -= sectors;
+    if (request->remaining == 0)
+    {
+        ata_finish(channel, 0);
+    }
+}
+
+static void ata_set_address(struct ata_device* device, unsigned int lba, int total, bool lba48)
+{
+    unsigned short base = device->channel->base;
+    unsigned char select = device->slave ? 0x10 : 0x00;
+    if (lba48)
+    {
+        // Each register takes its high order byte first, then the low order byte
+        outb(base + ATA_REG_DEVICE, 0x40 | select);
+        outb(base + ATA_REG_COUNT, (unsigned char)(total >> 8));
+        outb(base + ATA_REG_LBA0, (unsigned char)(lba >> 24));
+        outb(base + ATA_REG_LBA1, 0);
+        outb(base + ATA_REG_LBA2, 0);
+        outb(base + ATA_REG_COUNT, (unsigned char)(total & 0xff));
+        outb(base + ATA_REG_LBA0, (unsigned char)(lba & 0xff));
+        outb(base + ATA_REG_LBA1, (unsigned char)(lba >> 8));
+        outb(base + ATA_REG_LBA2, (unsigned char)(lba >> 16));
+        return;
+    }
+
+    outb(base + ATA_REG_DEVICE, ((lba >> 24) & 0x0f) | 0xE0 | select);
+    outb(base + ATA_REG_COUNT, total);
+    outb(base + ATA_REG_LBA0, (unsigned char)(lba & 0xff));
+    outb(base + ATA_REG_LBA1, (unsigned char)(lba >> 8));
+    outb(base + ATA_REG_LBA2, (unsigned char)(lba >> 16));
+}
+
+/**
+ * Issues a command for the transfer already set up in the channel's current request and returns
+ * without waiting for it. Must be called with interrupts disabled
+ */
+static int ata_issue(struct ata_device* device, unsigned char command, unsigned int lba, int total, bool lba48)
+{
+    struct ata_channel* channel = device->channel;
+    if (channel->current.dma)
+    {
+        outl(channel->bm_base + ATA_BM_PRDT, (uint32_t) channel->prdt);
+        outb(channel->bm_base + ATA_BM_COMMAND, ATA_BM_COMMAND_READ);
+        outb(channel->bm_base + ATA_BM_STATUS, ATA_BM_STATUS_ERR | ATA_BM_STATUS_IRQ);
+    }
+
+    ata_set_address(device, lba, total, lba48);
+
+    // The device needs 400ns after being selected, each alternate status read takes about 100ns
+    for (int i = 0; i < 4; i++)
+    {
+        insb(channel->control);
+    }
+    outb(channel->base + ATA_REG_COMMAND, command);
+
+    // A missing device would never interrupt, reading the alternate status does not acknowledge anything
+    unsigned char status = insb(channel->control);
+    if (status == 0x00 || status == 0xff)
+    {
+        channel->current.done = true;
+        return -EIO;
+    }
+
+    if (channel->current.dma)
+    {
+        outb(channel->bm_base + ATA_BM_COMMAND, ATA_BM_COMMAND_READ | ATA_BM_COMMAND_START);
+    }
+
+    return 0;
+}
+
+static void ata_prepare(struct ata_device* device, void* buf, int remaining, int block)
+{
+    struct ata_request* request = &device->channel->current;
+    request->device = device;
+    request->buf = (unsigned short*) buf;
+    request->remaining = remaining;
+    request->block = block;
+    request->dma = false;
+    request->res = 0;
+    request->done = false;
+}
+
+/**
+ * Does the interrupt handler's work once the device is no longer busy, for callers that wait
+ * with interrupts disabled. Must be called with interrupts disabled
+ */
+static void ata_poll(struct ata_channel* channel)
+{
+    // The alternate status does not acknowledge the interrupt, the handler's read does. BSY may
+    // take 400ns to show after a command is written, four reads of the register cover that
+    for (int i = 0; i < 3; i++)
+    {
+        insb(channel->control);
+    }
+
+    if (!(insb(channel->control) & ATA_STATUS_BSY))
+    {
+        ata_interrupt_handler(channel - ata_channels);
+    }
+}
+
+/**
+ * Issues a command that reads remaining sectors into buf, a sector at a time, and waits until
+ * it finished. Used for the commands sent while a device is being set up, which never address
+ * a sector. Sleeps on the channel's IRQ when the caller had interrupts enabled and polls the
+ * device otherwise, either way the caller's interrupt flag is left as it was
+ */
+static int ata_run(struct ata_device* device, unsigned char command, int total, void* buf, int remaining)
+{
+    struct ata_channel* channel = device->channel;
+    uint32_t flags = cpu_save_interrupts();
+    ata_prepare(device, buf, remaining, 1);
+    int res = ata_issue(device, command, 0, total, false);
+    if (res < 0)
+    {
+        cpu_restore_interrupts(flags);
+        return res;
+    }
+
+    while (!channel->current.done)
+    {
+        if (!(flags & CPU_FLAGS_IF))
+        {
+            ata_poll(channel);
+            continue;
+        }
+
+        // Sleep until the IRQ has moved every sector, the CPU is free for other interrupts meanwhile
+        cpu_halt_until_interrupt();
+        disable_interrupts();
+    }
+    cpu_restore_interrupts(flags);
+
+    return channel->current.res;
+}
+
+static int ata_start_read(struct ata_device* device, unsigned int lba, int total, void* buf)
+{
+    struct ata_channel* channel = device->channel;
+    bool lba48 = total > ATA_LBA28_MAX_SECTORS || lba + total > ATA_LBA28_MAX_LBA;
+    ata_prepare(device, buf, total, device->multiple);
+
+    // Buffers the controller can not reach fall back to PIO
+    channel->current.dma = channel->bm_base && ata_dma_build_prdt(channel, buf, total * OS_SECTOR_SIZE) == 0;
+    unsigned char command = 0;
+    if (channel->current.dma)
+    {
+        command = lba48 ? ATA_COMMAND_READ_DMA_EXT : ATA_COMMAND_READ_DMA;
+    }
+    else if (device->multiple > 1)
+    {
+        command = lba48 ? ATA_COMMAND_READ_MULTIPLE_EXT : ATA_COMMAND_READ_MULTIPLE;
+    }
+    else
+    {
+        command = lba48 ? ATA_COMMAND_READ_PIO_EXT : ATA_COMMAND_READ_PIO;
+    }
+
+    return ata_issue(device, command, lba, total, lba48);
+}
+
+/**
+ * Starts the next command of a queued read, large reads go out as a few big commands
+ */
+static int ata_start_next(struct ata_channel* channel)
+{
+    struct ata_request* request = &channel->current;
+    struct ata_device* device = request->device;
+    int max = device->lba48 ? ATA_LBA48_MAX_SECTORS : ATA_LBA28_MAX_SECTORS;
+    int count = request->left > max ? max : request->left;
+    unsigned int lba = request->next_lba;
+    char* buf = request->next_buf;
+
+    request->next_lba += count;
+    request->next_buf += count * OS_SECTOR_SIZE;
+    request->left -= count;
+    return ata_start_read(device, lba, count, buf);
+}
+
+/**
+ * Request queue entry point, runs with interrupts disabled
+ */
+static int ata_queue_start(struct disk_queue* queue, struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    struct ata_device* device = idisk->driver_private;
+    struct ata_request* request = &device->channel->current;
+    request->device = device;
+    request->queued = true;
+    request->next_lba = lba;
+    request->next_buf = buf;
+    request->left = total;
+
+    int res = ata_start_next(device->channel);
+    if (res < 0)
+    {
+        request->queued = false;
+    }
+
+    return res;
+}
+
+static void ata_queue_poll(struct disk_queue* queue)
+{
+    for (int i = 0; i < ATA_TOTAL_CHANNELS; i++)
+    {
+        if (&ata_channels[i].queue == queue)
+        {
+            ata_poll(&ata_channels[i]);
+        }
+    }
+}
+
+static int ata_read(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    struct ata_device* device = idisk->driver_private;
+    return disk_queue_read(&device->channel->queue, idisk, lba, total, buf);
+}
+
+static int ata_submit(struct disk* idisk, struct disk_request* request)
+{
+    struct ata_device* device = idisk->driver_private;
+    return disk_queue_submit(&device->channel->queue, request);
+}
+
+static void ata_disk_poll(struct disk* idisk)
+{
+    struct ata_device* device = idisk->driver_private;
+    uint32_t flags = cpu_save_interrupts();
+    ata_poll(device->channel);
+    cpu_restore_interrupts(flags);
+}
+
+static struct disk_driver ata_driver = {
+    .name = "ATA",
+    .read = ata_read,
+    .submit = ata_submit,
+    .poll = ata_disk_poll
+};
+
+/**
+ * Reads the device's IDENTIFY data for its size and LBA48 support, then has it move as many
+ * sectors per interrupt as it allows up to OS_DISK_MAX_MULTIPLE
+ */
+static int ata_identify(struct ata_device* device, struct disk* idisk)
+{
+    uint16_t identify[256];
+    int res = ata_run(device, ATA_COMMAND_IDENTIFY, 0, identify, 1);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    device->lba48 = ata_identify_lba48(identify);
+    idisk->sectors = ata_identify_sectors(identify);
+
+    // The block size has to be a power of two
+    int max_multiple = identify[ATA_IDENTIFY_MAX_MULTIPLE] & 0xff;
+    if (max_multiple > OS_DISK_MAX_MULTIPLE)
+    {
+        max_multiple = OS_DISK_MAX_MULTIPLE;
+    }
+
+    device->multiple = 1;
+    if (max_multiple > 1)
+    {
+        int multiple = 1 << (31 - __builtin_clz(max_multiple));
+        if (ata_run(device, ATA_COMMAND_SET_MULTIPLE, multiple, 0, 0) == 0)
+        {
+            device->multiple = multiple;
+        }
+    }
+
+    return 0;
+}
+
+static void ata_probe(struct ata_channel* channel, bool slave)
+{
+    struct ata_device* device = kzalloc(sizeof(struct ata_device));
+    struct disk* idisk = kzalloc(sizeof(struct disk));
+    if (!device || !idisk)
+    {
+        kfree(device);
+        kfree(idisk);
+        return;
+    }
+
+    device->channel = channel;
+    device->slave = slave;
+    device->multiple = 1;
+    if (ata_identify(device, idisk) < 0)
+    {
+        kfree(device);
+        kfree(idisk);
+        return;
+    }
+
+    idisk->type = PEACHOS_DISK_TYPE_REAL;
+    idisk->sector_size = OS_SECTOR_SIZE;
+    idisk->driver = &ata_driver;
+    idisk->driver_private = device;
+    if (disk_register(idisk) < 0)
+    {
+        kfree(device);
+        kfree(idisk);
+    }
+}
+
+/**
+ * Registers every ATA device that answers IDENTIFY on both legacy channels, each as its own disk
+ */
+void ata_init()
+{
+    ata_dma_init();
+    for (int i = 0; i < ATA_TOTAL_CHANNELS; i++)
+    {
+        struct ata_channel* channel = &ata_channels[i];
+
+        // Clear nIEN so the channel raises its IRQ
+        outb(channel->control, 0x00);
+        if (disk_queue_init(&channel->queue, ata_queue_start, ata_queue_poll) < 0)
+        {
+            print("Failed to create an ATA request queue\n");
+        }
+
+        ata_probe(channel, false);
+        ata_probe(channel, true);
+    }
+}
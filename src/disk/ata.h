@@ -0,0 +1,76 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "queue.h"
+
+#define ATA_PRIMARY   0
+#define ATA_SECONDARY 1
+#define ATA_TOTAL_CHANNELS 2
+#define ATA_DEVICES_PER_CHANNEL 2
+
+// Physical region descriptor, one physically contiguous piece of a DMA transfer
+struct ata_prd
+{
+    uint32_t address;
+
+    // Zero means 64KB
+    uint16_t bytes;
+    uint16_t flags;
+} __attribute__((packed));
+
+// The command a channel is working on, completed by its IRQ
+struct ata_request
+{
+    struct ata_device* device;
+
+    // PIO transfers are copied out a block of sectors at a time by the interrupt handler
+    unsigned short* buf;
+    volatile int remaining;
+    int block;
+    bool dma;
+    volatile int res;
+    volatile bool done;
+
+    // Set for reads from the request queue, which may need several commands
+    bool queued;
+    unsigned int next_lba;
+    int left;
+    char* next_buf;
+};
+
+struct ata_channel
+{
+    // Command block and control registers
+    unsigned short base;
+    unsigned short control;
+
+    // Bus master registers, zero when DMA is not available
+    unsigned short bm_base;
+
+    // One frame, so the table is aligned and never crosses a 64KB boundary
+    struct ata_prd* prdt;
+
+    struct ata_request current;
+
+    // Both devices on a channel share one queue since only one command can run at a time
+    struct disk_queue queue;
+};
+
+struct ata_device
+{
+    struct ata_channel* channel;
+    bool slave;
+
+    // What IDENTIFY told us about the device
+    bool lba48;
+
+    // Sectors moved per DRQ by READ MULTIPLE, 1 when it is not in use
+    int multiple;
+};
+
+void ata_init();
+void ata_interrupt_handler(int channel);
+
+#endif
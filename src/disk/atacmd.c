@@ -0,0 +1,85 @@
+#include "atacmd.h"
+#include "status.h"
+#include "memory/paging/paging.h"
+
+bool ata_identify_lba48(uint16_t* identify)
+{
+    return identify[ATA_IDENTIFY_COMMAND_SETS] & ATA_IDENTIFY_LBA48_SUPPORTED;
+}
+
+/**
+ * Size of the device in sectors from its IDENTIFY data
+ */
+unsigned int ata_identify_sectors(uint16_t* identify)
+{
+    if (!ata_identify_lba48(identify))
+    {
+        return identify[ATA_IDENTIFY_LBA28_SECTORS] | ((uint32_t) identify[ATA_IDENTIFY_LBA28_SECTORS + 1] << 16);
+    }
+
+    // Sizes past 2TB do not fit our 32 bit block numbers anyway
+    if (identify[ATA_IDENTIFY_LBA48_SECTORS + 2] | identify[ATA_IDENTIFY_LBA48_SECTORS + 3])
+    {
+        return 0xffffffff;
+    }
+
+    return identify[ATA_IDENTIFY_LBA48_SECTORS] | ((uint32_t) identify[ATA_IDENTIFY_LBA48_SECTORS + 1] << 16);
+}
+
+int ata_dma_walk_init(struct ata_dma_walk* walk, void* buf, uint32_t bytes)
+{
+    // Controllers want every run to start on an even address
+    if (bytes == 0 || ((uint32_t) buf & 0x01))
+    {
+        return -EINVARG;
+    }
+
+    walk->directory = paging_current_directory();
+    walk->buf = buf;
+    walk->bytes = bytes;
+    return 0;
+}
+
+/**
+ * Finds the next physically contiguous run of the buffer, translating it page by page so buffers
+ * only have to be virtually contiguous. A run never crosses a multiple of boundary, zero for none.
+ * Returns 1 for a run, 0 once the whole buffer has been walked
+ */
+int ata_dma_walk_next(struct ata_dma_walk* walk, uint32_t boundary, uint32_t* phys, uint32_t* length)
+{
+    uint32_t start = 0;
+    uint32_t run = 0;
+    while (walk->bytes > 0)
+    {
+        uint32_t virt = (uint32_t) walk->buf;
+        uint32_t page = walk->directory ? (uint32_t) paging_get_physical_address(walk->directory, walk->buf) : virt;
+        if (!page)
+        {
+            return -EINVARG;
+        }
+
+        if (run > 0 && (page != start + run || (boundary && page % boundary == 0)))
+        {
+            break;
+        }
+
+        if (run == 0)
+        {
+            start = page;
+        }
+
+        uint32_t piece = PAGING_PAGE_SIZE - (virt % PAGING_PAGE_SIZE);
+        if (piece > walk->bytes)
+        {
+            piece = walk->bytes;
+        }
+
+        run += piece;
+        walk->buf += piece;
+        walk->bytes -= piece;
+    }
+
+    *phys = start;
+    *length = run;
+    return run > 0;
+}
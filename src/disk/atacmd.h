@@ -0,0 +1,49 @@
+#ifndef ATACMD_H
+#define ATACMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The ATA command set, spoken by both the legacy IDE and the AHCI drivers
+
+#define ATA_STATUS_ERR 0x01
+#define ATA_STATUS_DRQ 0x08
+#define ATA_STATUS_BSY 0x80
+
+#define ATA_COMMAND_READ_PIO          0x20
+#define ATA_COMMAND_READ_PIO_EXT      0x24
+#define ATA_COMMAND_READ_DMA_EXT      0x25
+#define ATA_COMMAND_READ_MULTIPLE_EXT 0x29
+#define ATA_COMMAND_READ_FPDMA_QUEUED 0x60
+#define ATA_COMMAND_READ_MULTIPLE     0xC4
+#define ATA_COMMAND_SET_MULTIPLE      0xC6
+#define ATA_COMMAND_READ_DMA          0xC8
+#define ATA_COMMAND_IDENTIFY          0xEC
+
+// Words of the IDENTIFY data
+#define ATA_IDENTIFY_MAX_MULTIPLE      47
+#define ATA_IDENTIFY_LBA28_SECTORS     60
+#define ATA_IDENTIFY_QUEUE_DEPTH       75
+#define ATA_IDENTIFY_SATA_CAPABILITIES 76
+#define ATA_IDENTIFY_COMMAND_SETS      83
+#define ATA_IDENTIFY_LBA48_SECTORS     100
+#define ATA_IDENTIFY_LBA48_SUPPORTED   0x0400
+#define ATA_IDENTIFY_NCQ_SUPPORTED     0x0100
+
+// First sector LBA28 commands can not reach
+#define ATA_LBA28_MAX_LBA 0x10000000
+
+// A buffer being split into the physically contiguous runs a PRD table describes
+struct ata_dma_walk
+{
+    uint32_t* directory;
+    char* buf;
+    uint32_t bytes;
+};
+
+bool ata_identify_lba48(uint16_t* identify);
+unsigned int ata_identify_sectors(uint16_t* identify);
+int ata_dma_walk_init(struct ata_dma_walk* walk, void* buf, uint32_t bytes);
+int ata_dma_walk_next(struct ata_dma_walk* walk, uint32_t boundary, uint32_t* phys, uint32_t* length);
+
+#endif
@@ -0,0 +1,361 @@
+#include "cache.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "idt/idt.h"
+#include "cpu/cpu.h"
+
+/**
+ * Sectors read from any disk are kept in OS_DISK_CACHE_BLOCKS buffers. Lookups hash (disk, lba)
+ * into a bucket chain and the least recently used buffer is the one given up for a new sector
+ */
+static struct disk_cache disk_cache;
+
+static uint32_t disk_cache_hash(struct disk* idisk, unsigned int lba)
+{
+    return (lba ^ (idisk->id * 0x9E3779B1)) & (OS_DISK_CACHE_BLOCKS - 1);
+}
+
+static void disk_cache_unlink(struct disk_cache_block* block)
+{
+    if (block->prev)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        disk_cache.head = block->next;
+    }
+
+    if (block->next)
+    {
+        block->next->prev = block->prev;
+    }
+    else
+    {
+        disk_cache.tail = block->prev;
+    }
+
+    block->prev = 0;
+    block->next = 0;
+}
+
+static void disk_cache_push_front(struct disk_cache_block* block)
+{
+    block->next = disk_cache.head;
+    if (disk_cache.head)
+    {
+        disk_cache.head->prev = block;
+    }
+    disk_cache.head = block;
+    if (!disk_cache.tail)
+    {
+        disk_cache.tail = block;
+    }
+}
+
+static void disk_cache_push_back(struct disk_cache_block* block)
+{
+    block->prev = disk_cache.tail;
+    if (disk_cache.tail)
+    {
+        disk_cache.tail->next = block;
+    }
+    disk_cache.tail = block;
+    if (!disk_cache.head)
+    {
+        disk_cache.head = block;
+    }
+}
+
+static void disk_cache_hash_remove(struct disk_cache_block* block)
+{
+    struct disk_cache_block** link = &disk_cache.buckets[disk_cache_hash(block->disk, block->lba)];
+    while (*link)
+    {
+        if (*link == block)
+        {
+            *link = block->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+
+    block->hash_next = 0;
+    block->valid = false;
+}
+
+static struct disk_cache_block* disk_cache_lookup(struct disk* idisk, unsigned int lba)
+{
+    struct disk_cache_block* block = disk_cache.buckets[disk_cache_hash(idisk, lba)];
+    while (block)
+    {
+        if (block->disk == idisk && block->lba == lba)
+        {
+            return block;
+        }
+        block = block->hash_next;
+    }
+
+    return 0;
+}
+
+int disk_cache_init()
+{
+    memset(&disk_cache, 0, sizeof(disk_cache));
+    disk_cache.blocks = kzalloc(sizeof(struct disk_cache_block) * OS_DISK_CACHE_BLOCKS);
+    disk_cache.buckets = kzalloc(sizeof(struct disk_cache_block*) * OS_DISK_CACHE_BLOCKS);
+    disk_cache.readahead_buffer = kmalloc(OS_DISK_READAHEAD_MAX * OS_SECTOR_SIZE);
+    char* data = kmalloc(OS_DISK_CACHE_BLOCKS * OS_SECTOR_SIZE);
+    if (!disk_cache.blocks || !disk_cache.buckets || !disk_cache.readahead_buffer || !data)
+    {
+        kfree(disk_cache.blocks);
+        kfree(disk_cache.buckets);
+        kfree(disk_cache.readahead_buffer);
+        kfree(data);
+        memset(&disk_cache, 0, sizeof(disk_cache));
+        return -ENOMEM;
+    }
+
+    for (int i = 0; i < OS_DISK_CACHE_BLOCKS; i++)
+    {
+        disk_cache.blocks[i].data = data + (i * OS_SECTOR_SIZE);
+        disk_cache_push_back(&disk_cache.blocks[i]);
+    }
+
+    return 0;
+}
+
+bool disk_cache_contains(struct disk* idisk, unsigned int lba)
+{
+    return disk_cache.blocks && disk_cache_lookup(idisk, lba) != 0;
+}
+
+/**
+ * Stores sectors that were just read from the disk, each one takes the least recently used buffer
+ */
+void disk_cache_fill(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    if (!disk_cache.blocks)
+    {
+        return;
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        struct disk_cache_block* block = disk_cache_lookup(idisk, lba + i);
+        if (!block)
+        {
+            block = disk_cache.tail;
+            if (block->valid)
+            {
+                disk_cache_hash_remove(block);
+                disk_cache.stats.evictions++;
+            }
+
+            uint32_t bucket = disk_cache_hash(idisk, lba + i);
+            block->disk = idisk;
+            block->lba = lba + i;
+            block->valid = true;
+            block->hash_next = disk_cache.buckets[bucket];
+            disk_cache.buckets[bucket] = block;
+        }
+
+        memcpy(block->data, buf + (i * OS_SECTOR_SIZE), OS_SECTOR_SIZE);
+        disk_cache_unlink(block);
+        disk_cache_push_front(block);
+    }
+}
+
+static void disk_cache_readahead_done(struct disk_request* request, int res)
+{
+    disk_cache.readahead_state = DISK_CACHE_READAHEAD_DONE;
+}
+
+/**
+ * Moves a finished read-ahead into the cache
+ */
+static void disk_cache_readahead_collect()
+{
+    if (disk_cache.readahead_state != DISK_CACHE_READAHEAD_DONE)
+    {
+        return;
+    }
+
+    struct disk_request* request = &disk_cache.readahead_request;
+    if (request->res >= 0 && !disk_cache.readahead_stale)
+    {
+        disk_cache_fill(request->disk, request->lba, request->total, request->buf);
+        disk_cache.stats.readahead += request->total;
+    }
+
+    disk_cache.readahead_state = DISK_CACHE_READAHEAD_IDLE;
+}
+
+static bool disk_cache_readahead_covers(struct disk* idisk, unsigned int lba)
+{
+    struct disk_request* request = &disk_cache.readahead_request;
+    return disk_cache.readahead_state != DISK_CACHE_READAHEAD_IDLE && request->disk == idisk &&
+           lba >= request->lba && lba < request->lba + request->total;
+}
+
+/**
+ * Waits for the read-ahead to finish and collects it. A caller with interrupts disabled keeps
+ * them disabled and has the drivers poll their controllers instead
+ */
+static void disk_cache_readahead_wait()
+{
+    uint32_t flags = cpu_save_interrupts();
+    while (disk_cache.readahead_state == DISK_CACHE_READAHEAD_BUSY)
+    {
+        if (!(flags & CPU_FLAGS_IF))
+        {
+            disk_poll();
+            continue;
+        }
+
+        cpu_halt_until_interrupt();
+        disable_interrupts();
+    }
+    cpu_restore_interrupts(flags);
+
+    disk_cache_readahead_collect();
+}
+
+/**
+ * Serves what it can from the cache, every run of missing sectors is read with one command
+ * straight into buf and then added to the cache. Sectors the read-ahead is still bringing in
+ * are waited for rather than read a second time
+ */
+int disk_cache_read(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    if (!disk_cache.blocks)
+    {
+        return disk_read_uncached(idisk, lba, total, buf);
+    }
+
+    disk_cache_readahead_collect();
+    int i = 0;
+    while (i < total)
+    {
+        if (!disk_cache_lookup(idisk, lba + i) && disk_cache_readahead_covers(idisk, lba + i))
+        {
+            disk_cache_readahead_wait();
+        }
+
+        struct disk_cache_block* block = disk_cache_lookup(idisk, lba + i);
+        if (block)
+        {
+            memcpy(buf + (i * OS_SECTOR_SIZE), block->data, OS_SECTOR_SIZE);
+            disk_cache_unlink(block);
+            disk_cache_push_front(block);
+            disk_cache.stats.hits++;
+            i++;
+            continue;
+        }
+
+        int run = 1;
+        while (i + run < total && !disk_cache_lookup(idisk, lba + i + run) && !disk_cache_readahead_covers(idisk, lba + i + run))
+        {
+            run++;
+        }
+
+        int res = disk_read_uncached(idisk, lba + i, run, buf + (i * OS_SECTOR_SIZE));
+        if (res < 0)
+        {
+            return res;
+        }
+
+        disk_cache_fill(idisk, lba + i, run, buf + (i * OS_SECTOR_SIZE));
+        disk_cache.stats.misses += run;
+        i += run;
+    }
+
+    return 0;
+}
+
+/**
+ * Starts reading sectors into the cache and returns without waiting for them. Cached sectors at
+ * the front are skipped, nothing past the end of the disk is requested and only one read-ahead
+ * is out at a time
+ */
+void disk_cache_prefetch(struct disk* idisk, unsigned int lba, int total)
+{
+    disk_cache_readahead_collect();
+    if (!disk_cache.blocks || total <= 0 || total > OS_DISK_READAHEAD_MAX ||
+        disk_cache.readahead_state != DISK_CACHE_READAHEAD_IDLE)
+    {
+        return;
+    }
+
+    if (idisk->sectors)
+    {
+        if (lba >= idisk->sectors)
+        {
+            return;
+        }
+
+        if (lba + total > idisk->sectors)
+        {
+            total = idisk->sectors - lba;
+        }
+    }
+
+    while (total > 0 && disk_cache_lookup(idisk, lba))
+    {
+        lba++;
+        total--;
+    }
+
+    if (total == 0)
+    {
+        return;
+    }
+
+    // One command for the whole range, sectors in it that are cached already are read again
+    struct disk_request* request = &disk_cache.readahead_request;
+    memset(request, 0, sizeof(struct disk_request));
+    request->type = DISK_REQUEST_READ;
+    request->disk = idisk;
+    request->lba = lba;
+    request->total = total;
+    request->buf = disk_cache.readahead_buffer;
+    request->callback = disk_cache_readahead_done;
+    disk_cache.readahead_stale = false;
+    disk_cache.readahead_state = DISK_CACHE_READAHEAD_BUSY;
+    if (disk_submit(request) < 0)
+    {
+        disk_cache.readahead_state = DISK_CACHE_READAHEAD_IDLE;
+    }
+}
+
+void disk_cache_invalidate(struct disk* idisk)
+{
+    if (!disk_cache.blocks)
+    {
+        return;
+    }
+
+    if (disk_cache.readahead_state != DISK_CACHE_READAHEAD_IDLE && disk_cache.readahead_request.disk == idisk)
+    {
+        disk_cache.readahead_stale = true;
+    }
+
+    for (int i = 0; i < OS_DISK_CACHE_BLOCKS; i++)
+    {
+        struct disk_cache_block* block = &disk_cache.blocks[i];
+        if (block->valid && block->disk == idisk)
+        {
+            disk_cache_hash_remove(block);
+            disk_cache_unlink(block);
+            disk_cache_push_back(block);
+        }
+    }
+}
+
+void disk_cache_get_stats(struct disk_cache_stats* stats)
+{
+    memcpy(stats, &disk_cache.stats, sizeof(struct disk_cache_stats));
+}
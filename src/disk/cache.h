@@ -0,0 +1,68 @@
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "queue.h"
+
+struct disk;
+
+// Where the one read-ahead request the cache can have is at
+#define DISK_CACHE_READAHEAD_IDLE 0
+#define DISK_CACHE_READAHEAD_BUSY 1
+#define DISK_CACHE_READAHEAD_DONE 2
+
+// One cached sector
+struct disk_cache_block
+{
+    struct disk* disk;
+    unsigned int lba;
+    bool valid;
+
+    // Next block in the same hash bucket
+    struct disk_cache_block* hash_next;
+
+    // Least recently used order, the head was used last
+    struct disk_cache_block* prev;
+    struct disk_cache_block* next;
+
+    char* data;
+};
+
+struct disk_cache_stats
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+
+    // Sectors brought in by read-ahead rather than by a reader
+    uint32_t readahead;
+};
+
+struct disk_cache
+{
+    struct disk_cache_block* blocks;
+    struct disk_cache_block** buckets;
+    struct disk_cache_block* head;
+    struct disk_cache_block* tail;
+    struct disk_cache_stats stats;
+
+    // Read-ahead lands here and is copied into the cache by the next reader, the completion
+    // runs in interrupt context and leaves the cache alone
+    char* readahead_buffer;
+    struct disk_request readahead_request;
+    volatile int readahead_state;
+
+    // Set when the disk was invalidated while the read-ahead was out
+    bool readahead_stale;
+};
+
+int disk_cache_init();
+int disk_cache_read(struct disk* idisk, unsigned int lba, int total, void* buf);
+void disk_cache_fill(struct disk* idisk, unsigned int lba, int total, void* buf);
+void disk_cache_prefetch(struct disk* idisk, unsigned int lba, int total);
+bool disk_cache_contains(struct disk* idisk, unsigned int lba);
+void disk_cache_invalidate(struct disk* idisk);
+void disk_cache_get_stats(struct disk_cache_stats* stats);
+
+#endif
@@ -1,64 +1,104 @@
 #include "disk.h"
-#include "io/io.h"
+#include "ata.h"
+#include "ahci.h"
+#include "cache.h"
 #include "config.h"
 #include "status.h"
-#include "memory/memory.h"
+#include "kernel.h"
+#include <stdbool.h>
 
-struct disk disk;
+static struct disk* disks[OS_MAX_DISKS];
 
-int disk_read_sector(int lba, int total, void* buf)
+/**
+ * Gives the disk the next free id, called by drivers for every device they find
+ */
+int disk_register(struct disk* idisk)
 {
-    outb(0x1F6, (lba >> 24) | 0xE0);
-    outb(0x1F2, total);
-    outb(0x1F3, (unsigned char)(lba & 0xff));
-    outb(0x1F4, (unsigned char)(lba >> 8));
-    outb(0x1F5, (unsigned char)(lba >> 16));
-    outb(0x1F7, 0x20);
-
-    unsigned short* ptr = (unsigned short*) buf;
-    for (int b = 0; b < total; b++)
+    for (int i = 0; i < OS_MAX_DISKS; i++)
     {
-        // Wait for the buffer to be ready
-        char c = insb(0x1F7);
-        while(!(c & 0x08))
+        if (disks[i] == 0)
         {
-            c = insb(0x1F7);
+            idisk->id = i;
+            disks[i] = idisk;
+            return 0;
         }
-
-        // Copy from hard disk to memory
-        for (int i = 0; i < 256; i++)
-        {
-            *ptr = insw(0x1F0);
-            ptr++;
-        }
-
     }
-    return 0;
+
+    print("Disk register failed, too many disks\n");
+    return -ENOMEM;
 }
 
 void disk_search_and_init()
 {
-    memset(&disk, 0, sizeof(disk));
-    disk.type = PEACHOS_DISK_TYPE_REAL;
-    disk.sector_size = OS_SECTOR_SIZE;
-    disk.id = 0;
-    disk.filesystem = fs_resolve(&disk);
+    if (disk_cache_init() < 0)
+    {
+        print("Failed to create the disk cache\n");
+    }
+
+    ata_init();
+    ahci_init();
+    for (int i = 0; i < OS_MAX_DISKS; i++)
+    {
+        if (disks[i])
+        {
+            disks[i]->filesystem = fs_resolve(disks[i]);
+        }
+    }
 }
 
 struct disk* disk_get(int index)
 {
-    if (index != 0)
+    if (index < 0 || index >= OS_MAX_DISKS)
         return 0;
     
-    return &disk;
+    return disks[index];
+}
+
+static bool disk_is_registered(struct disk* idisk)
+{
+    return idisk && idisk->id >= 0 && idisk->id < OS_MAX_DISKS && disks[idisk->id] == idisk;
+}
+
+int disk_read_uncached(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    if (!disk_is_registered(idisk))
+    {
+        return -EIO;
+    }
+
+    return idisk->driver->read(idisk, lba, total, buf);
+}
+
+int disk_submit(struct disk_request* request)
+{
+    if (!disk_is_registered(request->disk))
+    {
+        return -EIO;
+    }
+
+    return request->disk->driver->submit(request->disk, request);
+}
+
+/**
+ * Gives drivers without an interrupt the chance to complete submitted requests
+ */
+void disk_poll()
+{
+    for (int i = 0; i < OS_MAX_DISKS; i++)
+    {
+        if (disks[i] && disks[i]->driver->poll)
+        {
+            disks[i]->driver->poll(disks[i]);
+        }
+    }
 }
 
 int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf)
 {
-    if (idisk != &disk)
+    if (!disk_is_registered(idisk))
     {
         return -EIO;
     }
 
-    return disk_read_sector(lba, total, buf);
-}
\ No newline at end of file
+    return disk_cache_read(idisk, lba, total, buf);
+}
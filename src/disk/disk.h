@@ -2,6 +2,7 @@
 #define DISK_H
 
 #include "fs/file.h"
+#include "queue.h"
 
 typedef unsigned int OS_DISK_TYPE;
 
@@ -9,11 +10,35 @@ typedef unsigned int OS_DISK_TYPE;
 // Represents a real physical hard disk
 #define PEACHOS_DISK_TYPE_REAL 0
 
+struct disk;
+typedef int (*DISK_READ_FUNCTION)(struct disk* idisk, unsigned int lba, int total, void* buf);
+typedef int (*DISK_SUBMIT_FUNCTION)(struct disk* idisk, struct disk_request* request);
+typedef void (*DISK_POLL_FUNCTION)(struct disk* idisk);
+
+// The controller a disk is attached to
+struct disk_driver
+{
+    char name[20];
+
+    // Reads sectors and waits for them
+    DISK_READ_FUNCTION read;
+
+    // Queues a read that completes through the request's callback
+    DISK_SUBMIT_FUNCTION submit;
+
+    // Optional, completes requests without waiting for the controller's interrupt. Used for
+    // controllers that can not interrupt us and by callers waiting with interrupts disabled
+    DISK_POLL_FUNCTION poll;
+};
+
 struct disk
 {
     OS_DISK_TYPE type;
     int sector_size;
 
+    // Size of the disk in sectors as reported by the drive
+    unsigned int sectors;
+
     // The id of the disk
     int id;
 
@@ -21,10 +46,19 @@ struct disk
 
     // The private data of our filesystem
     void* fs_private;
+
+    struct disk_driver* driver;
+
+    // The private data of our driver
+    void* driver_private;
 };
 
 void disk_search_and_init();
+int disk_register(struct disk* idisk);
 struct disk* disk_get(int index);
 int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_read_uncached(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_submit(struct disk_request* request);
+void disk_poll();
 
-#endif
\ No newline at end of file
+#endif
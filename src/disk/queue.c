@@ -0,0 +1,192 @@
+#include "queue.h"
+#include "config.h"
+#include "status.h"
+#include "idt/idt.h"
+#include "cpu/cpu.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include <stdbool.h>
+
+int disk_queue_init(struct disk_queue* queue, DISK_QUEUE_START start, DISK_QUEUE_POLL poll)
+{
+    memset(queue, 0, sizeof(struct disk_queue));
+    queue->start = start;
+    queue->poll = poll;
+    queue->merge_buffer = kmalloc(OS_DISK_QUEUE_MERGE_MAX * OS_SECTOR_SIZE);
+    if (!queue->merge_buffer)
+    {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Completes every request of the finished command. Data is copied out of the merge buffer before
+ * any callback runs, so a callback is free to submit again
+ */
+static void disk_queue_finish(struct disk_queue* queue, int res)
+{
+    struct disk_request* request = queue->active;
+    if (request->merged && res >= 0)
+    {
+        char* data = queue->merge_buffer;
+        for (struct disk_request* r = request; r; r = r->merged)
+        {
+            memcpy(r->buf, data, r->total * OS_SECTOR_SIZE);
+            data += r->total * OS_SECTOR_SIZE;
+        }
+    }
+
+    queue->active = 0;
+    while (request)
+    {
+        struct disk_request* next = request->merged;
+        request->merged = 0;
+        request->res = res;
+        if (request->callback)
+        {
+            request->callback(request, res);
+        }
+        request = next;
+    }
+}
+
+/**
+ * Starts the next command if the device is idle. Requests are taken in one direction across
+ * the disk, and pending requests that carry on exactly where the chosen one ends join its command
+ */
+static void disk_queue_dispatch(struct disk_queue* queue)
+{
+    while (queue->pending && !queue->active)
+    {
+        struct disk_request** link = &queue->pending;
+        while (*link && (*link)->lba < queue->head)
+        {
+            link = &(*link)->next;
+        }
+
+        if (!*link)
+        {
+            link = &queue->pending;
+        }
+
+        struct disk_request* first = *link;
+        *link = first->next;
+        first->next = 0;
+
+        int total = first->total;
+        struct disk_request* last = first;
+        while (queue->merge_buffer && *link && (*link)->disk == first->disk && (*link)->lba == first->lba + total &&
+               total + (*link)->total <= OS_DISK_QUEUE_MERGE_MAX)
+        {
+            struct disk_request* request = *link;
+            *link = request->next;
+            request->next = 0;
+            last->merged = request;
+            last = request;
+            total += request->total;
+            queue->stats.merged++;
+        }
+
+        queue->active = first;
+        queue->head = first->lba + total;
+        queue->stats.dispatched++;
+
+        void* buf = first->merged ? queue->merge_buffer : first->buf;
+        int res = queue->start(queue, first->disk, first->lba, total, buf);
+        if (res < 0)
+        {
+            disk_queue_finish(queue, res);
+        }
+    }
+}
+
+/**
+ * Queues a request and returns straight away, its callback runs once the data is in request->buf
+ */
+int disk_queue_submit(struct disk_queue* queue, struct disk_request* request)
+{
+    if (request->total <= 0 || request->type != DISK_REQUEST_READ)
+    {
+        return -EINVARG;
+    }
+
+    uint32_t flags = cpu_save_interrupts();
+    request->res = 0;
+    request->merged = 0;
+
+    // Equal LBAs keep the order they were submitted in
+    struct disk_request** link = &queue->pending;
+    while (*link && (*link)->lba <= request->lba)
+    {
+        link = &(*link)->next;
+    }
+    request->next = *link;
+    *link = request;
+    queue->stats.submitted++;
+
+    disk_queue_dispatch(queue);
+    cpu_restore_interrupts(flags);
+    return 0;
+}
+
+/**
+ * Called by the driver from its interrupt handler when the command it was given has finished
+ */
+void disk_queue_complete(struct disk_queue* queue, int res)
+{
+    if (!queue->active)
+    {
+        return;
+    }
+
+    disk_queue_finish(queue, res);
+    disk_queue_dispatch(queue);
+}
+
+static void disk_queue_wake(struct disk_request* request, int res)
+{
+    *(volatile bool*) request->private = true;
+}
+
+/**
+ * Submits a read and sleeps until it has finished, only for use outside interrupt handlers.
+ * A caller with interrupts disabled keeps them disabled and the device is polled instead
+ */
+int disk_queue_read(struct disk_queue* queue, struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    volatile bool done = false;
+    struct disk_request request;
+    memset(&request, 0, sizeof(request));
+    request.type = DISK_REQUEST_READ;
+    request.disk = idisk;
+    request.lba = lba;
+    request.total = total;
+    request.buf = buf;
+    request.callback = disk_queue_wake;
+    request.private = (void*) &done;
+
+    uint32_t flags = cpu_save_interrupts();
+    int res = disk_queue_submit(queue, &request);
+    if (res < 0)
+    {
+        cpu_restore_interrupts(flags);
+        return res;
+    }
+
+    while (!done)
+    {
+        if (!(flags & CPU_FLAGS_IF) && queue->poll)
+        {
+            queue->poll(queue);
+            continue;
+        }
+
+        cpu_halt_until_interrupt();
+        disable_interrupts();
+    }
+    cpu_restore_interrupts(flags);
+
+    return request.res;
+}
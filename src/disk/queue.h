@@ -0,0 +1,74 @@
+#ifndef DISKQUEUE_H
+#define DISKQUEUE_H
+
+#include <stdint.h>
+
+struct disk;
+struct disk_request;
+struct disk_queue;
+
+typedef int DISK_REQUEST_TYPE;
+
+#define DISK_REQUEST_READ 0
+
+// Called once the request has finished, from interrupt context
+typedef void (*DISK_REQUEST_CALLBACK)(struct disk_request* request, int res);
+
+// Starts one command for total sectors at lba, the driver calls disk_queue_complete when it is done
+typedef int (*DISK_QUEUE_START)(struct disk_queue* queue, struct disk* idisk, unsigned int lba, int total, void* buf);
+
+// Checks the device for a finished command without its interrupt, called with interrupts disabled
+typedef void (*DISK_QUEUE_POLL)(struct disk_queue* queue);
+
+struct disk_request
+{
+    DISK_REQUEST_TYPE type;
+    struct disk* disk;
+    unsigned int lba;
+    int total;
+    void* buf;
+
+    DISK_REQUEST_CALLBACK callback;
+    void* private;
+    int res;
+
+    // Next pending request in LBA order
+    struct disk_request* next;
+
+    // Next request served by the same command after being merged with this one
+    struct disk_request* merged;
+};
+
+struct disk_queue_stats
+{
+    uint32_t submitted;
+    uint32_t dispatched;
+    uint32_t merged;
+};
+
+struct disk_queue
+{
+    DISK_QUEUE_START start;
+    DISK_QUEUE_POLL poll;
+
+    // Requests waiting for the device, sorted by LBA
+    struct disk_request* pending;
+
+    // The requests the current command serves, chained through merged
+    struct disk_request* active;
+
+    // The elevator sweeps upwards from here and wraps around to the lowest LBA
+    unsigned int head;
+
+    // Merged commands land here and are copied out to each request when they finish
+    char* merge_buffer;
+
+    struct disk_queue_stats stats;
+};
+
+int disk_queue_init(struct disk_queue* queue, DISK_QUEUE_START start, DISK_QUEUE_POLL poll);
+int disk_queue_submit(struct disk_queue* queue, struct disk_request* request);
+void disk_queue_complete(struct disk_queue* queue, int res);
+int disk_queue_read(struct disk_queue* queue, struct disk* idisk, unsigned int lba, int total, void* buf);
+
+#endif
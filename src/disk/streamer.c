@@ -1,6 +1,8 @@
 #include "streamer.h"
 #include "memory/heap/kheap.h"
 #include "config.h"
+#include "cache.h"
+#include <stdbool.h>
 struct disk_stream* diskstreamer_new(int disk_id)
 {
     struct disk* disk = disk_get(disk_id);
@@ -21,12 +23,59 @@ int diskstreamer_seek(struct disk_stream* stream, int pos)
     return 0;
 }
 
+/**
+ * Starts reading this sector and the ones after it into the block cache while the stream reads
+ * sequentially, going back to the disk once the reader is halfway through what was read ahead
+ * last time. The read runs in the background, the reader only waits for the sector it needs
+ */
+static void diskstreamer_readahead(struct disk_stream* stream, unsigned int sector)
+{
+    if (stream->has_last_sector && sector == stream->last_sector)
+    {
+        return;
+    }
+
+    bool sequential = stream->has_last_sector && sector == stream->last_sector + 1;
+    stream->has_last_sector = true;
+    stream->last_sector = sector;
+    if (!sequential)
+    {
+        stream->readahead_window = 0;
+        stream->readahead_end = 0;
+        return;
+    }
+
+    if (stream->readahead_window == 0)
+    {
+        stream->readahead_window = OS_DISK_READAHEAD_MIN;
+    }
+    else if (stream->readahead_window < OS_DISK_READAHEAD_MAX)
+    {
+        stream->readahead_window *= 2;
+    }
+
+    if (sector + (stream->readahead_window / 2) < stream->readahead_end)
+    {
+        return;
+    }
+
+    unsigned int start = sector > stream->readahead_end ? sector : stream->readahead_end;
+    unsigned int end = sector + stream->readahead_window;
+    if (end > start)
+    {
+        disk_cache_prefetch(stream->disk, start, end - start);
+        stream->readahead_end = end;
+    }
+}
+
 int diskstreamer_read(struct disk_stream* stream, void* out, int total)
 {
     int sector = stream->pos / OS_SECTOR_SIZE;
     int offset = stream->pos % OS_SECTOR_SIZE;
     char buf[OS_SECTOR_SIZE];
 
+    diskstreamer_readahead(stream, sector);
+
     int res = disk_read_block(stream->disk, sector, 1, buf);
     if (res < 0)
     {
@@ -2,11 +2,19 @@
 #define DISKSTREAMER_H
 
 #include "disk.h"
+#include <stdbool.h>
 
 struct disk_stream
 {
     int pos;
     struct disk* disk;
+
+    // Read-ahead state, the window grows while reads stay sequential and drops to zero otherwise.
+    // The window counts the sector being read, which goes out in the same request
+    bool has_last_sector;
+    unsigned int last_sector;
+    unsigned int readahead_end;
+    int readahead_window;
 };
 
 struct disk_stream* diskstreamer_new(int disk_id);
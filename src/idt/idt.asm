@@ -1,11 +1,19 @@
 section .asm
 
 extern int21h_handler
+extern int2eh_handler
+extern int2fh_handler
 extern no_interrupt_handler
+extern page_fault_handler
+extern irq_handler
 
 global int21h
+global int2eh
+global int2fh
 global idt_load
 global no_interrupt
+global page_fault
+global irq_stub_table
 global enable_interrupts
 global disable_interrupts
 
@@ -36,6 +44,22 @@ int21h:
     sti
     iret
 
+int2eh:
+    cli
+    pushad
+    call int2eh_handler
+    popad
+    sti
+    iret
+
+int2fh:
+    cli
+    pushad
+    call int2fh_handler
+    popad
+    sti
+    iret
+
 no_interrupt:
     cli
     pushad
@@ -44,4 +68,50 @@ no_interrupt:
     sti
     iret
 
-    
\ No newline at end of file
+page_fault:
+    cli
+    pushad
+    ; Faulting address and the error code the CPU pushed before pushad
+    mov eax, cr2
+    push eax
+    push dword [esp+36]
+    call page_fault_handler
+    add esp, 8
+    popad
+    ; The error code has to be popped before returning
+    add esp, 4
+    sti
+    iret
+
+; Entry for IRQ lines that drivers claim at runtime, passes the line on to irq_handler
+%macro irq_stub 1
+irq%1:
+    cli
+    pushad
+    push dword %1
+    call irq_handler
+    add esp, 4
+    popad
+    sti
+    iret
+%endmacro
+
+irq_stub 0
+irq_stub 1
+irq_stub 2
+irq_stub 3
+irq_stub 4
+irq_stub 5
+irq_stub 6
+irq_stub 7
+irq_stub 8
+irq_stub 9
+irq_stub 10
+irq_stub 11
+irq_stub 12
+irq_stub 13
+irq_stub 14
+irq_stub 15
+
+irq_stub_table:
+    dd irq0, irq1, irq2, irq3, irq4, irq5, irq6, irq7, irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15
@@ -3,12 +3,21 @@
 #include "kernel.h"
 #include "memory/memory.h"
 #include "io/io.h"
+#include "memory/paging/paging.h"
+#include "disk/ata.h"
+#include "status.h"
 struct idt_desc idt_descriptors[OS_TOTAL_INTERRUPTS];
 struct idtr_desc idtr_descriptor;
 
 extern void idt_load(struct idtr_desc* ptr);
 extern void int21h();
+extern void int2eh();
+extern void int2fh();
+extern void page_fault();
 extern void no_interrupt();
+extern void* irq_stub_table[IDT_TOTAL_IRQS];
+
+static IRQ_HANDLER_FUNCTION irq_handlers[IDT_TOTAL_IRQS];
 
 void int21h_handler()
 {
@@ -16,6 +25,32 @@ void int21h_handler()
     outb(0x20, 0x20);
 }
 
+void int2eh_handler()
+{
+    // IRQ14 comes through the slave PIC so both need an end of interrupt
+    ata_interrupt_handler(ATA_PRIMARY);
+    outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+}
+
+void int2fh_handler()
+{
+    // IRQ15 is the secondary ATA channel
+    ata_interrupt_handler(ATA_SECONDARY);
+    outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+}
+
+void irq_handler(int irq)
+{
+    irq_handlers[irq](irq);
+    if (irq >= 8)
+    {
+        outb(0xA0, 0x20);
+    }
+    outb(0x20, 0x20);
+}
+
 void no_interrupt_handler()
 {
     outb(0x20, 0x20);
@@ -26,6 +61,15 @@ void idt_zero()
     print("Divide by zero error\n");
 }
 
+void page_fault_handler(uint32_t error, uint32_t address)
+{
+    // Touching a reserved page commits it, anything else is a real fault
+    if (paging_handle_fault((void*) address, error) < 0)
+    {
+        panic("Page fault\n");
+    }
+}
+
 void idt_set(int interrupt_no, void* address)
 {
     struct idt_desc* desc = &idt_descriptors[interrupt_no];
@@ -36,6 +80,32 @@ void idt_set(int interrupt_no, void* address)
     desc->offset_2 = (uint32_t) address >> 16;
 }
 
+/**
+ * Hands an IRQ line to a driver and unmasks it, for devices such as PCI controllers whose line is
+ * only known at runtime. Lines that already have a vector of their own can not be claimed
+ */
+int idt_register_irq(int irq, IRQ_HANDLER_FUNCTION handler)
+{
+    if (irq < 0 || irq >= IDT_TOTAL_IRQS || irq == 2 || irq_handlers[irq])
+    {
+        return -EINVARG;
+    }
+
+    struct idt_desc* desc = &idt_descriptors[IDT_IRQ_BASE + irq];
+    uint32_t address = desc->offset_1 | ((uint32_t) desc->offset_2 << 16);
+    if (address != (uint32_t) no_interrupt)
+    {
+        return -EINVARG;
+    }
+
+    irq_handlers[irq] = handler;
+    idt_set(IDT_IRQ_BASE + irq, irq_stub_table[irq]);
+
+    unsigned short mask_port = irq < 8 ? 0x21 : 0xA1;
+    outb(mask_port, insb(mask_port) & ~(1 << (irq % 8)));
+    return 0;
+}
+
 void idt_init()
 {
     memset(idt_descriptors, 0, sizeof(idt_descriptors));
@@ -48,7 +118,10 @@ void idt_init()
     }
 
     idt_set(0, idt_zero);
+    idt_set(14, page_fault);
     idt_set(0x21, int21h);
+    idt_set(0x2E, int2eh);
+    idt_set(0x2F, int2fh);
 
 
     // Load the interrupt descriptor table
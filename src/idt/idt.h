@@ -17,7 +17,14 @@ struct idtr_desc
     uint32_t base;
 }__attribute__((packed));
 
+// Vector the first PIC line is remapped to, the slave follows at 8
+#define IDT_IRQ_BASE 0x20
+#define IDT_TOTAL_IRQS 16
+
+typedef void (*IRQ_HANDLER_FUNCTION)(int irq);
+
 void idt_init();
+int idt_register_irq(int irq, IRQ_HANDLER_FUNCTION handler);
 void enable_interrupts();
 void disable_interrupts();
 #endif
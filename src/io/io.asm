@@ -4,6 +4,12 @@ global insb
 global insw
 global outb
 global outw
+global insl
+global outl
+global insw_rep
+global outsw_rep
+global insl_rep
+global outsl_rep
 
 insb:
     push ebp
@@ -46,4 +52,84 @@ outw:
     out dx,ax
 
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+insl:
+    push ebp
+    mov ebp,esp
+    mov edx,[ebp+8]
+    in eax,dx
+
+    pop ebp
+    ret
+
+outl:
+    push ebp 
+    mov ebp,esp 
+
+    mov eax,[ebp+12] 
+    mov edx,[ebp+8] 
+    out dx,eax
+
+    pop ebp
+    ret
+
+insw_rep:
+    push ebp
+    mov ebp,esp
+    push edi
+
+    mov edx,[ebp+8]
+    mov edi,[ebp+12]
+    mov ecx,[ebp+16]
+    cld
+    rep insw
+
+    pop edi
+    pop ebp
+    ret
+
+outsw_rep:
+    push ebp
+    mov ebp,esp
+    push esi
+
+    mov edx,[ebp+8]
+    mov esi,[ebp+12]
+    mov ecx,[ebp+16]
+    cld
+    rep outsw
+
+    pop esi
+    pop ebp
+    ret
+
+insl_rep:
+    push ebp
+    mov ebp,esp
+    push edi
+
+    mov edx,[ebp+8]
+    mov edi,[ebp+12]
+    mov ecx,[ebp+16]
+    cld
+    rep insd
+
+    pop edi
+    pop ebp
+    ret
+
+outsl_rep:
+    push ebp
+    mov ebp,esp
+    push esi
+
+    mov edx,[ebp+8]
+    mov esi,[ebp+12]
+    mov ecx,[ebp+16]
+    cld
+    rep outsd
+
+    pop esi
+    pop ebp
+    ret
@@ -2,9 +2,17 @@
 #define IO_H
 
 unsigned char insb(unsigned short port);
-unsigned char insw(unsigned short port);
+unsigned short insw(unsigned short port);
+unsigned int insl(unsigned short port);
 
 void outb(unsigned short port,unsigned char val);
-void outw(unsigned short port,unsigned char val);
+void outw(unsigned short port,unsigned short val);
+void outl(unsigned short port,unsigned int val);
+
+// Move count words or dwords between a port and memory with a single rep instruction
+void insw_rep(unsigned short port, void* buf, unsigned int count);
+void outsw_rep(unsigned short port, void* buf, unsigned int count);
+void insl_rep(unsigned short port, void* buf, unsigned int count);
+void outsl_rep(unsigned short port, void* buf, unsigned int count);
 
 #endif
\ No newline at end of file
@@ -28,10 +28,33 @@ _start:
     mov al, 0x20 ; Interrupt 0x20 is where master ISR should start
     out 0x21, al
 
+    mov al, 00000100b ; The slave PIC is cascaded on IRQ2
+    out 0x21, al
+
     mov al, 00000001b
     out 0x21, al
     ; End remap of the master PIC
 
+    ; Remap the slave PIC
+    mov al, 00010001b
+    out 0xA0, al ; Tell slave PIC
+
+    mov al, 0x28 ; Interrupt 0x28 is where slave ISR should start
+    out 0xA1, al
+
+    mov al, 00000010b ; Cascade identity of the slave
+    out 0xA1, al
+
+    mov al, 00000001b
+    out 0xA1, al
+
+    ; Only the two ATA channels are unmasked on the slave
+    mov al, 00111111b
+    out 0xA1, al
+    ; End remap of the slave PIC
+
+    ; The bootloader leaves the address of the E820 memory map in ebx
+    push ebx
     call kernel_main
 
     jmp $
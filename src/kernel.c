@@ -3,6 +3,9 @@
 #include <stdint.h>
 #include "idt/idt.h"
 #include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/memmap/memmap.h"
+#include "memory/vmalloc/vmalloc.h"
 #include "memory/paging/paging.h"
 #include "string/string.h"
 #include "fs/file.h"
@@ -43,7 +46,7 @@ void terminal_writechar(char c, char colour)
 }
 void terminal_initialize()
 {
-    video_mem = (uint16_t*)(0xB8000);
+    video_mem = (uint16_t*)(VGA_MEMORY_ADDRESS);
     terminal_row = 0;
     terminal_col = 0;
     for (int y = 0; y < VGA_HEIGHT; y++)
@@ -75,35 +78,60 @@ void panic(const char* msg)
     while(1) {}
 }
 
-void kernel_main()
+void kernel_main(struct memmap* memory_map)
 {
     terminal_initialize();
     print("Hello world!\ntest");
 
-    // Initialize the heap
-    kheap_init();
+    // Size the heap and frame pool from the memory the BIOS reported
+    struct memmap_region heap_region;
+    struct memmap_region frame_region;
+    memmap_get_kernel_regions(memory_map, &heap_region, &frame_region);
 
-    // Initialize filesystems
-    fs_init();
+    // Initialize the heap
+    kheap_init(heap_region.start, heap_region.end);
 
-    // Search and initialize the disks
-    disk_search_and_init();
+    // Initialize the physical frame allocator
+    frame_init(frame_region.start, frame_region.end);
 
     // Initialize the interrupt descriptor table
     idt_init();
 
     // Setup paging
+    paging_init_pat();
     kernel_chunk = paging_new_4gb(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+
+    // The low 4MB holds the kernel image and its stack, they and the heap and frame pool are
+    // the kernel's own memory
+    uint32_t* kernel_directory = paging_4gb_chunk_get_directory(kernel_chunk);
+    if (paging_map_kernel(kernel_directory, (void*) 0, (void*) PAGING_LARGE_PAGE_SIZE) < 0 ||
+        paging_map_kernel(kernel_directory, heap_region.start, heap_region.end) < 0 ||
+        paging_map_kernel(kernel_directory, frame_region.start, frame_region.end) < 0)
+    {
+        panic("Failed to map kernel memory\n");
+    }
     
     // Switch to kernel paging chunk
     paging_switch(paging_4gb_chunk_get_directory(kernel_chunk));
 
     // Enable paging
     enable_paging();
+
+    // Console output is combined into burst writes to the VGA buffer
+    paging_map_write_combining(paging_4gb_chunk_get_directory(kernel_chunk), (void*) VGA_MEMORY_ADDRESS, (void*) VGA_MEMORY_ADDRESS, VGA_MEMORY_SIZE);
+
+    // Large kernel buffers are mapped into the kernel chunk
+    vmalloc_init(paging_4gb_chunk_get_directory(kernel_chunk));
     
     // Enable the system interrupts
     enable_interrupts();
 
+    // Initialize filesystems
+    fs_init();
+
+    // Search and initialize the disks, reads complete on IRQ14 so interrupts must be enabled
+    disk_search_and_init();
+
     int fd = fopen("0:/hello.txt", "r");
     if (fd)
     {
@@ -113,5 +141,12 @@ void kernel_main()
 
         print("Testing.....\n");
     }
-    while(1) {}
+
+    // Use idle time to build up the pool of zeroed heap blocks and to complete disk requests on
+    // controllers that have to be polled
+    while(1)
+    {
+        kheap_idle();
+        disk_poll();
+    }
 }
\ No newline at end of file
@@ -3,10 +3,13 @@
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 20
+#define VGA_MEMORY_ADDRESS 0xB8000
+#define VGA_MEMORY_SIZE 0x8000
 
 #define OS_MAX_PATH 108
 
-void kernel_main();
+struct memmap;
+void kernel_main(struct memmap* memory_map);
 void print(const char* str);
 void panic(const char* msg);
 
@@ -0,0 +1,285 @@
+#include "frame.h"
+#include "kernel.h"
+#include "status.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+struct frame_pool kernel_frame_pool;
+
+static bool frame_is_used(struct frame_pool* pool, uint32_t frame)
+{
+    return pool->bitmap[frame / 32] & (1 << (frame % 32));
+}
+
+static void frame_mark_used(struct frame_pool* pool, uint32_t frame)
+{
+    pool->bitmap[frame / 32] |= (1 << (frame % 32));
+    pool->free--;
+}
+
+static void frame_mark_free(struct frame_pool* pool, uint32_t frame)
+{
+    pool->bitmap[frame / 32] &= ~(1 << (frame % 32));
+    pool->free++;
+}
+
+static void frame_push(struct frame_pool* pool, uint32_t frame)
+{
+    // The bitmap is the source of truth, a full stack just means we scan later
+    if (pool->stack_top < pool->total)
+    {
+        pool->stack[pool->stack_top++] = frame;
+    }
+}
+
+int frame_pool_create(struct frame_pool* pool, void* ptr, void* end)
+{
+    int res = 0;
+    if (((uint32_t) ptr % FRAME_SIZE) || ((uint32_t) end % FRAME_SIZE) || end <= ptr)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    // The bitmap, free stack and share counts live in the first frames of the region
+    uint32_t total_frames = (end - ptr) / FRAME_SIZE;
+    uint32_t bitmap_words = (total_frames + 31) / 32;
+    uint32_t metadata_bytes = (bitmap_words + total_frames) * sizeof(uint32_t) + total_frames * sizeof(uint16_t);
+    uint32_t metadata_frames = (metadata_bytes + FRAME_SIZE - 1) / FRAME_SIZE;
+    if (metadata_frames >= total_frames)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    memset(pool, 0, sizeof(struct frame_pool));
+    pool->bitmap = (uint32_t*) ptr;
+    pool->stack = pool->bitmap + bitmap_words;
+    pool->shares = (uint16_t*)(pool->stack + total_frames);
+    pool->saddr = (uint32_t) ptr + (metadata_frames * FRAME_SIZE);
+    pool->total = total_frames - metadata_frames;
+    pool->free = pool->total;
+    memset(pool->shares, 0, pool->total * sizeof(uint16_t));
+
+    // Bits past the end of the pool stay set so they are never handed out
+    memset(pool->bitmap, 0xff, bitmap_words * sizeof(uint32_t));
+    for (uint32_t i = 0; i < pool->total; i++)
+    {
+        pool->bitmap[i / 32] &= ~(1 << (i % 32));
+    }
+
+    // Push in reverse so the lowest frames are handed out first
+    for (int i = pool->total - 1; i >= 0; i--)
+    {
+        frame_push(pool, i);
+    }
+
+out:
+    return res;
+}
+
+static uint32_t frame_to_index(struct frame_pool* pool, void* frame)
+{
+    return ((uint32_t) frame - pool->saddr) / FRAME_SIZE;
+}
+
+static void* frame_index_to_address(struct frame_pool* pool, uint32_t index)
+{
+    return (void*)(pool->saddr + (index * FRAME_SIZE));
+}
+
+static void* frame_pool_take_run(struct frame_pool* pool, uint32_t total)
+{
+    if (total == 0 || total > pool->free)
+    {
+        return 0;
+    }
+
+    uint32_t run_start = 0;
+    uint32_t run_length = 0;
+    uint32_t frame = 0;
+    while (frame < pool->total)
+    {
+        // Whole words in use can be skipped at once
+        if ((frame % 32) == 0 && pool->bitmap[frame / 32] == 0xffffffff)
+        {
+            run_length = 0;
+            frame += 32;
+            continue;
+        }
+
+        if (frame_is_used(pool, frame))
+        {
+            run_length = 0;
+            frame++;
+            continue;
+        }
+
+        if (run_length == 0)
+        {
+            run_start = frame;
+        }
+
+        run_length++;
+        frame++;
+        if (run_length == total)
+        {
+            for (uint32_t i = run_start; i < run_start + total; i++)
+            {
+                frame_mark_used(pool, i);
+            }
+            return frame_index_to_address(pool, run_start);
+        }
+    }
+
+    return 0;
+}
+
+void* frame_pool_alloc(struct frame_pool* pool)
+{
+    void* address = 0;
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+
+    // Skip entries taken by contiguous allocations since they were pushed
+    while (pool->stack_top > 0)
+    {
+        uint32_t frame = pool->stack[--pool->stack_top];
+        if (!frame_is_used(pool, frame))
+        {
+            frame_mark_used(pool, frame);
+            address = frame_index_to_address(pool, frame);
+            goto out;
+        }
+    }
+
+    // The stack overflowed at some point, fall back to the bitmap
+    address = frame_pool_take_run(pool, 1);
+
+out:
+    spin_unlock_irqrestore(&pool->lock, flags);
+    return address;
+}
+
+void* frame_pool_alloc_contiguous(struct frame_pool* pool, uint32_t total)
+{
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    void* address = frame_pool_take_run(pool, total);
+    spin_unlock_irqrestore(&pool->lock, flags);
+    return address;
+}
+
+static void frame_pool_release(struct frame_pool* pool, void* frame)
+{
+    uint32_t index = frame_to_index(pool, frame);
+    if (index >= pool->total || !frame_is_used(pool, index))
+    {
+        return;
+    }
+
+    // Someone else still maps this frame, just drop our reference
+    if (pool->shares[index] > 0)
+    {
+        pool->shares[index]--;
+        return;
+    }
+
+    frame_mark_free(pool, index);
+    frame_push(pool, index);
+}
+
+void frame_pool_free(struct frame_pool* pool, void* frame)
+{
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    frame_pool_release(pool, frame);
+    spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+void frame_pool_free_contiguous(struct frame_pool* pool, void* frame, uint32_t total)
+{
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    for (uint32_t i = 0; i < total; i++)
+    {
+        frame_pool_release(pool, frame + (i * FRAME_SIZE));
+    }
+    spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/**
+ * Takes another reference on an allocated frame, it is only freed once every reference is dropped
+ */
+int frame_pool_ref(struct frame_pool* pool, void* frame)
+{
+    int res = 0;
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    uint32_t index = frame_to_index(pool, frame);
+    if (index >= pool->total || !frame_is_used(pool, index))
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (pool->shares[index] == 0xffff)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    pool->shares[index]++;
+
+out:
+    spin_unlock_irqrestore(&pool->lock, flags);
+    return res;
+}
+
+uint32_t frame_pool_refcount(struct frame_pool* pool, void* frame)
+{
+    uint32_t refcount = 0;
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    uint32_t index = frame_to_index(pool, frame);
+    if (index < pool->total && frame_is_used(pool, index))
+    {
+        refcount = pool->shares[index] + 1;
+    }
+
+    spin_unlock_irqrestore(&pool->lock, flags);
+    return refcount;
+}
+
+void frame_init(void* start, void* end)
+{
+    int res = frame_pool_create(&kernel_frame_pool, start, end);
+    if (res < 0)
+    {
+        print("Failed to create frame pool\n");
+    }
+}
+
+void* frame_alloc()
+{
+    return frame_pool_alloc(&kernel_frame_pool);
+}
+
+void* frame_alloc_contiguous(uint32_t total)
+{
+    return frame_pool_alloc_contiguous(&kernel_frame_pool, total);
+}
+
+void frame_free(void* frame)
+{
+    frame_pool_free(&kernel_frame_pool, frame);
+}
+
+void frame_free_contiguous(void* frame, uint32_t total)
+{
+    frame_pool_free_contiguous(&kernel_frame_pool, frame, total);
+}
+
+int frame_ref(void* frame)
+{
+    return frame_pool_ref(&kernel_frame_pool, frame);
+}
+
+uint32_t frame_refcount(void* frame)
+{
+    return frame_pool_refcount(&kernel_frame_pool, frame);
+}
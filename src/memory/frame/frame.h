@@ -0,0 +1,48 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu/cpu.h"
+
+#define FRAME_SIZE 4096
+
+struct frame_pool
+{
+    // Physical address of the first frame handed out by the pool
+    uint32_t saddr;
+    uint32_t total;
+    uint32_t free;
+
+    // One bit per frame, set when the frame is in use
+    uint32_t* bitmap;
+
+    // Free frame numbers for O(1) single frame allocation, may hold stale entries
+    uint32_t* stack;
+    uint32_t stack_top;
+
+    // References held on each frame besides the one taken by allocating it
+    uint16_t* shares;
+
+    // Guards everything above. Page faults and interrupt handlers use frames too, so it is
+    // taken with interrupts disabled
+    SPINLOCK lock;
+};
+
+int frame_pool_create(struct frame_pool* pool, void* ptr, void* end);
+void* frame_pool_alloc(struct frame_pool* pool);
+void* frame_pool_alloc_contiguous(struct frame_pool* pool, uint32_t total);
+void frame_pool_free(struct frame_pool* pool, void* frame);
+void frame_pool_free_contiguous(struct frame_pool* pool, void* frame, uint32_t total);
+int frame_pool_ref(struct frame_pool* pool, void* frame);
+uint32_t frame_pool_refcount(struct frame_pool* pool, void* frame);
+
+void frame_init(void* start, void* end);
+void* frame_alloc();
+void* frame_alloc_contiguous(uint32_t total);
+void frame_free(void* frame);
+void frame_free_contiguous(void* frame, uint32_t total);
+int frame_ref(void* frame);
+uint32_t frame_refcount(void* frame);
+
+#endif
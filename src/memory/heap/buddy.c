@@ -0,0 +1,166 @@
+#include "buddy.h"
+#include "heap.h"
+#include "memory/memory.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Binary buddy backend for struct heap. Block n of order k covers 2^k heap blocks
+ * and its buddy is block n ^ 2^k. Free blocks of order k live in heap->free_heads[k],
+ * the size of every free or allocated block is kept in the node of its first block.
+ */
+
+static uint32_t heap_buddy_order_for_blocks(uint32_t total_blocks)
+{
+    uint32_t order = 0;
+    while ((1u << order) < total_blocks)
+    {
+        order++;
+    }
+
+    return order;
+}
+
+void heap_buddy_create(struct heap* heap)
+{
+    struct heap_table* table = heap->table;
+    memset(table->nodes, 0, sizeof(struct heap_free_node) * table->total);
+
+    // Cover the heap with the largest naturally aligned blocks that fit
+    uint32_t block = 0;
+    while (block < table->total)
+    {
+        uint32_t order = block ? __builtin_ctz(block) : 31;
+        while (order > 0 && block + (1u << order) > table->total)
+        {
+            order--;
+        }
+
+        heap_free_run_insert(heap, block, 1 << order);
+        block += (1 << order);
+    }
+}
+
+static bool heap_buddy_is_free_block(struct heap* heap, uint32_t block, uint32_t order)
+{
+    struct heap_table* table = heap->table;
+    if (block >= table->total)
+    {
+        return false;
+    }
+
+    return (table->entries[block] & 0x0f) == HEAP_BLOCK_TABLE_ENTRY_FREE && table->nodes[block].size == (1u << order);
+}
+
+void* heap_buddy_malloc(struct heap* heap, size_t size)
+{
+    uint32_t total_blocks = (size + OS_HEAP_BLOCK_SIZE - 1) / OS_HEAP_BLOCK_SIZE;
+    if (total_blocks == 0)
+    {
+        return 0;
+    }
+
+    uint32_t order = heap_buddy_order_for_blocks(total_blocks);
+    uint32_t candidates = order < HEAP_FREE_CLASSES ? heap->free_classes & ~((1u << order) - 1) : 0;
+    if (!candidates)
+    {
+        heap->stats.failed_allocations++;
+        return 0;
+    }
+
+    uint32_t current_order = __builtin_ctz(candidates);
+    uint32_t block = heap->free_heads[current_order];
+    heap_free_run_remove(heap, block);
+
+    // Split down to the order we need, handing the upper halves back
+    while (current_order > order)
+    {
+        current_order--;
+        heap_free_run_insert(heap, block + (1 << current_order), 1 << current_order);
+    }
+
+    heap->table->entries[block] = HEAP_BLOCK_TABLE_ENTRY_TAKEN | HEAP_BLOCK_IS_FIRST;
+    heap->table->nodes[block].size = 1 << order;
+    heap_stats_allocated(heap, 1 << order);
+    return heap_block_to_address(heap, block);
+}
+
+void heap_buddy_free(struct heap* heap, void* ptr)
+{
+    struct heap_table* table = heap->table;
+    uint32_t block = heap_address_to_block(heap, ptr);
+    uint32_t order = heap_buddy_order_for_blocks(table->nodes[block].size);
+    heap_stats_freed(heap, 1 << order);
+
+    table->entries[block] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+    table->nodes[block].size = 0;
+
+    // Merge with our buddy for as long as it is free and whole
+    while (order + 1 < HEAP_FREE_CLASSES)
+    {
+        uint32_t buddy = block ^ (1u << order);
+        if (!heap_buddy_is_free_block(heap, buddy, order))
+        {
+            break;
+        }
+
+        heap_free_run_remove(heap, buddy);
+        table->nodes[buddy].size = 0;
+        if (buddy < block)
+        {
+            block = buddy;
+        }
+        order++;
+    }
+
+    heap_free_run_insert(heap, block, 1 << order);
+}
+
+bool heap_buddy_resize_in_place(struct heap* heap, uint32_t block, uint32_t total_blocks)
+{
+    struct heap_table* table = heap->table;
+    uint32_t order = heap_buddy_order_for_blocks(table->nodes[block].size);
+    uint32_t new_order = heap_buddy_order_for_blocks(total_blocks);
+    if (new_order == order)
+    {
+        return true;
+    }
+
+    if (new_order < order)
+    {
+        // Hand back upper halves, their buddies are still ours so nothing can merge
+        while (order > new_order)
+        {
+            order--;
+            heap_free_run_insert(heap, block + (1 << order), 1 << order);
+        }
+
+        heap->stats.blocks_used -= table->nodes[block].size - (1 << new_order);
+        table->nodes[block].size = 1 << new_order;
+        return true;
+    }
+
+    // We can only grow while we are the lower buddy and every upper buddy is free
+    for (uint32_t current = order; current < new_order; current++)
+    {
+        if ((block & ((2u << current) - 1)) != 0 || !heap_buddy_is_free_block(heap, block + (1 << current), current))
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t current = order; current < new_order; current++)
+    {
+        uint32_t buddy = block + (1 << current);
+        heap_free_run_remove(heap, buddy);
+        table->nodes[buddy].size = 0;
+    }
+
+    heap->stats.blocks_used += (1 << new_order) - table->nodes[block].size;
+    if (heap->stats.blocks_used > heap->stats.blocks_high_water)
+    {
+        heap->stats.blocks_high_water = heap->stats.blocks_used;
+    }
+    table->nodes[block].size = 1 << new_order;
+    return true;
+}
@@ -0,0 +1,13 @@
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include "heap.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+void heap_buddy_create(struct heap* heap);
+void* heap_buddy_malloc(struct heap* heap, size_t size);
+void heap_buddy_free(struct heap* heap, void* ptr);
+bool heap_buddy_resize_in_place(struct heap* heap, uint32_t block, uint32_t total_blocks);
+
+#endif
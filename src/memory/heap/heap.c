@@ -1,4 +1,5 @@
 #include "heap.h"
+#include "buddy.h"
 #include "kernel.h"
 #include "status.h"
 #include "memory/memory.h"
@@ -25,7 +26,58 @@ static bool heap_validate_alignment(void* ptr)
     return ((unsigned int)ptr % OS_HEAP_BLOCK_SIZE) == 0;
 }
 
-int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* table)
+static int heap_free_class(uint32_t total_blocks)
+{
+    return 31 - __builtin_clz(total_blocks);
+}
+
+void heap_free_run_insert(struct heap* heap, uint32_t start_block, uint32_t total_blocks)
+{
+    struct heap_free_node* nodes = heap->table->nodes;
+    int class = heap_free_class(total_blocks);
+
+    // Both ends of the run carry its size so neighbours can find the start
+    nodes[start_block].size = total_blocks;
+    nodes[start_block + total_blocks - 1].size = total_blocks;
+
+    nodes[start_block].prev = HEAP_NO_BLOCK;
+    nodes[start_block].next = heap->free_heads[class];
+    if (heap->free_heads[class] != HEAP_NO_BLOCK)
+    {
+        nodes[heap->free_heads[class]].prev = start_block;
+    }
+
+    heap->free_heads[class] = start_block;
+    heap->free_classes |= (1 << class);
+}
+
+void heap_free_run_remove(struct heap* heap, uint32_t start_block)
+{
+    struct heap_free_node* nodes = heap->table->nodes;
+    struct heap_free_node* node = &nodes[start_block];
+    int class = heap_free_class(node->size);
+
+    if (node->prev != HEAP_NO_BLOCK)
+    {
+        nodes[node->prev].next = node->next;
+    }
+    else
+    {
+        heap->free_heads[class] = node->next;
+    }
+
+    if (node->next != HEAP_NO_BLOCK)
+    {
+        nodes[node->next].prev = node->prev;
+    }
+
+    if (heap->free_heads[class] == HEAP_NO_BLOCK)
+    {
+        heap->free_classes &= ~(1 << class);
+    }
+}
+
+int heap_create(struct heap* heap, HEAP_TYPE type, void* ptr, void* end, struct heap_table* table)
 {
     int res = 0;
 
@@ -36,6 +88,7 @@ int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* tabl
     }
 
     memset(heap, 0, sizeof(struct heap));
+    heap->type = type;
     heap->saddr = ptr;
     heap->table = table;
 
@@ -48,6 +101,32 @@ int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* tabl
     size_t table_size = sizeof(HEAP_BLOCK_TABLE_ENTRY) * table->total;
     memset(table->entries, HEAP_BLOCK_TABLE_ENTRY_FREE, table_size);
 
+    for (int i = 0; i < HEAP_FREE_CLASSES; i++)
+    {
+        heap->free_heads[i] = HEAP_NO_BLOCK;
+    }
+
+    // Nothing is known about the memory we were given
+    heap->dirty_free_blocks = table->total;
+
+    switch (type)
+    {
+    case HEAP_TYPE_TABLE:
+        if (table->total > 0)
+        {
+            heap_free_run_insert(heap, 0, table->total);
+        }
+        break;
+
+    case HEAP_TYPE_BUDDY:
+        heap_buddy_create(heap);
+        break;
+
+    default:
+        res = -EINVARG;
+        break;
+    }
+
 out:
     return res;
 }
@@ -69,40 +148,53 @@ static int heap_get_entry_type(HEAP_BLOCK_TABLE_ENTRY entry)
     return entry & 0x0f;
 }
 
-int heap_get_start_block(struct heap* heap, uint32_t total_blocks)
+static uint32_t heap_free_list_find(struct heap* heap, int class, uint32_t total_blocks, int limit)
 {
-    struct heap_table* table = heap->table;
-    int bc = 0;
-    int bs = -1;
-
-    for (size_t i = 0; i < table->total; i++)
+    struct heap_free_node* nodes = heap->table->nodes;
+    uint32_t block = heap->free_heads[class];
+    while (block != HEAP_NO_BLOCK && limit-- != 0)
     {
-        if (heap_get_entry_type(table->entries[i]) != HEAP_BLOCK_TABLE_ENTRY_FREE)
+        if (nodes[block].size >= total_blocks)
         {
-            bc = 0;
-            bs = -1;
-            continue;
+            return block;
         }
+        block = nodes[block].next;
+    }
 
-        // If this is the first block
-        if (bs == -1)
-        {
-            bs = i;
-        }
-        bc++;
-        if (bc == total_blocks)
-        {
-            break;
-        }
+    return HEAP_NO_BLOCK;
+}
+
+int heap_get_start_block(struct heap* heap, uint32_t total_blocks)
+{
+    if (total_blocks == 0)
+    {
+        return -EINVARG;
+    }
+
+    int class = heap_free_class(total_blocks);
+
+    // Try for a close fit in the run's own size class first
+    uint32_t block = heap_free_list_find(heap, class, total_blocks, HEAP_FREE_SCAN_LIMIT);
+    if (block != HEAP_NO_BLOCK)
+    {
+        return block;
     }
 
-    if (bs == -1)
+    // Every run in a larger class is big enough, so take the head of the smallest one
+    uint32_t larger_classes = class < 31 ? heap->free_classes & ~((2u << class) - 1) : 0;
+    if (larger_classes)
+    {
+        return heap->free_heads[__builtin_ctz(larger_classes)];
+    }
+
+    // Last resort, walk the rest of our own class
+    block = heap_free_list_find(heap, class, total_blocks, -1);
+    if (block == HEAP_NO_BLOCK)
     {
         return -ENOMEM;
     }
-    
-    return bs;
 
+    return block;
 }
 
 void* heap_block_to_address(struct heap* heap, int block)
@@ -131,37 +223,114 @@ void heap_mark_blocks_taken(struct heap* heap, int start_block, int total_blocks
     }
 }
 
-void* heap_malloc_blocks(struct heap* heap, uint32_t total_blocks)
+void heap_stats_allocated(struct heap* heap, uint32_t total_blocks)
+{
+    struct heap_stats* stats = &heap->stats;
+    stats->allocations++;
+    stats->blocks_used += total_blocks;
+    if (stats->blocks_used > stats->blocks_high_water)
+    {
+        stats->blocks_high_water = stats->blocks_used;
+    }
+}
+
+void heap_stats_freed(struct heap* heap, uint32_t total_blocks)
+{
+    heap->stats.frees++;
+    heap->stats.blocks_used -= total_blocks;
+}
+
+/**
+ * Called for free blocks that are about to be handed out. Keeps the count of dirty free
+ * blocks right and, when zero is set, clears the blocks that are not already known to be zero.
+ */
+static void heap_take_free_blocks(struct heap* heap, uint32_t start_block, uint32_t total_blocks, bool zero)
+{
+    for (uint32_t i = start_block; i < start_block + total_blocks; i++)
+    {
+        if (heap->table->entries[i] & HEAP_BLOCK_IS_ZERO)
+        {
+            continue;
+        }
+
+        heap->dirty_free_blocks--;
+        if (zero)
+        {
+            memset(heap_block_to_address(heap, i), 0x00, OS_HEAP_BLOCK_SIZE);
+        }
+    }
+}
+
+static void* heap_malloc_blocks(struct heap* heap, uint32_t total_blocks, bool zero)
 {
     void* address = 0;
 
     int start_block = heap_get_start_block(heap, total_blocks);
     if (start_block < 0)
     {
+        heap->stats.failed_allocations++;
         goto out;
     }
 
+    // Take the blocks from the front of the run and index whatever is left
+    uint32_t run_size = heap->table->nodes[start_block].size;
+    heap_free_run_remove(heap, start_block);
+    if (run_size > total_blocks)
+    {
+        heap_free_run_insert(heap, start_block + total_blocks, run_size - total_blocks);
+    }
+
     address = heap_block_to_address(heap, start_block);
+    heap_take_free_blocks(heap, start_block, total_blocks, zero);
 
     // Mark the blocks as taken
     heap_mark_blocks_taken(heap, start_block, total_blocks);
+    heap_stats_allocated(heap, total_blocks);
 
 out:
     return address;
 }
 
-void heap_mark_blocks_free(struct heap* heap, int starting_block)
+int heap_mark_blocks_free(struct heap* heap, int starting_block)
 {
     struct heap_table* table = heap->table;
+    int total_blocks = 0;
     for (int i = starting_block; i < (int)table->total; i++)
     {
         HEAP_BLOCK_TABLE_ENTRY entry = table->entries[i];
         table->entries[i] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+        total_blocks++;
         if (!(entry & HEAP_BLOCK_HAS_NEXT))
         {
             break;
         }
     }
+
+    return total_blocks;
+}
+
+static void heap_free_run_coalesce(struct heap* heap, uint32_t start_block, uint32_t total_blocks)
+{
+    struct heap_table* table = heap->table;
+
+    // A free block just before us is the last block of a free run
+    if (start_block > 0 && heap_get_entry_type(table->entries[start_block - 1]) == HEAP_BLOCK_TABLE_ENTRY_FREE)
+    {
+        uint32_t left_size = table->nodes[start_block - 1].size;
+        start_block -= left_size;
+        total_blocks += left_size;
+        heap_free_run_remove(heap, start_block);
+    }
+
+    // A free block just after us is the first block of a free run
+    uint32_t right_block = start_block + total_blocks;
+    if (right_block < table->total && heap_get_entry_type(table->entries[right_block]) == HEAP_BLOCK_TABLE_ENTRY_FREE)
+    {
+        total_blocks += table->nodes[right_block].size;
+        heap_free_run_remove(heap, right_block);
+    }
+
+    heap_free_run_insert(heap, start_block, total_blocks);
 }
 
 int heap_address_to_block(struct heap* heap, void* address)
@@ -171,12 +340,262 @@ int heap_address_to_block(struct heap* heap, void* address)
 
 void* heap_malloc(struct heap* heap, size_t size)
 {
+    if (heap->type == HEAP_TYPE_BUDDY)
+    {
+        return heap_buddy_malloc(heap, size);
+    }
+
     size_t aligned_size = heap_align_value_to_upper(size);
     uint32_t total_blocks = aligned_size / OS_HEAP_BLOCK_SIZE;
-    return heap_malloc_blocks(heap, total_blocks);
+    return heap_malloc_blocks(heap, total_blocks, false);
+}
+
+void* heap_zalloc(struct heap* heap, size_t size)
+{
+    if (heap->type == HEAP_TYPE_BUDDY)
+    {
+        void* ptr = heap_buddy_malloc(heap, size);
+        if (ptr)
+        {
+            memset(ptr, 0x00, size);
+        }
+        return ptr;
+    }
+
+    // Blocks the idle zeroing already cleared are not touched again
+    size_t aligned_size = heap_align_value_to_upper(size);
+    uint32_t total_blocks = aligned_size / OS_HEAP_BLOCK_SIZE;
+    return heap_malloc_blocks(heap, total_blocks, true);
 }
 
 void heap_free(struct heap* heap, void* ptr)
 {
-    heap_mark_blocks_free(heap, heap_address_to_block(heap, ptr));
-}
\ No newline at end of file
+    if (heap->type == HEAP_TYPE_BUDDY)
+    {
+        heap_buddy_free(heap, ptr);
+        return;
+    }
+
+    int start_block = heap_address_to_block(heap, ptr);
+    int total_blocks = heap_mark_blocks_free(heap, start_block);
+    heap_free_run_coalesce(heap, start_block, total_blocks);
+    heap_stats_freed(heap, total_blocks);
+    heap->dirty_free_blocks += total_blocks;
+}
+
+static bool heap_free_run_starts_at(struct heap* heap, uint32_t block)
+{
+    HEAP_BLOCK_TABLE_ENTRY* entries = heap->table->entries;
+    if (heap_get_entry_type(entries[block]) != HEAP_BLOCK_TABLE_ENTRY_FREE)
+    {
+        return false;
+    }
+
+    return block == 0 || heap_get_entry_type(entries[block - 1]) != HEAP_BLOCK_TABLE_ENTRY_FREE;
+}
+
+/**
+ * Takes a free block that still holds old data out of its free run so it can be zeroed without
+ * holding the heap lock. Give it back with heap_release_zeroed_block once it is zeroed.
+ * Returns the block or -ENOMEM when every free block is already zero.
+ */
+int heap_claim_dirty_block(struct heap* heap)
+{
+    struct heap_table* table = heap->table;
+
+    // Interior blocks of buddy allocations look free in the table, only the table backend is safe
+    if (!(heap->flags & HEAP_FLAG_ZERO_POOL) || heap->type != HEAP_TYPE_TABLE)
+    {
+        return -ENOMEM;
+    }
+
+    for (size_t scanned = 0; scanned < table->total && heap->dirty_free_blocks > 0; scanned++)
+    {
+        uint32_t block = heap->zero_cursor;
+        heap->zero_cursor = (heap->zero_cursor + 1) % table->total;
+
+        HEAP_BLOCK_TABLE_ENTRY entry = table->entries[block];
+        if (heap_get_entry_type(entry) != HEAP_BLOCK_TABLE_ENTRY_FREE)
+        {
+            continue;
+        }
+
+        // Splitting the run needs its first block. Runs are entered from the front as the
+        // cursor walks, so only a cursor left part way through a changed run has to skip it
+        if (heap_free_run_starts_at(heap, block))
+        {
+            heap->zero_run = block;
+        }
+        else if (heap->zero_run > block || !heap_free_run_starts_at(heap, heap->zero_run) ||
+                 heap->zero_run + table->nodes[heap->zero_run].size <= block)
+        {
+            continue;
+        }
+
+        if (entry & HEAP_BLOCK_IS_ZERO)
+        {
+            continue;
+        }
+
+        uint32_t run_start = heap->zero_run;
+        uint32_t run_end = run_start + table->nodes[run_start].size;
+        heap_free_run_remove(heap, run_start);
+        if (block > run_start)
+        {
+            heap_free_run_insert(heap, run_start, block - run_start);
+        }
+
+        if (run_end > block + 1)
+        {
+            heap_free_run_insert(heap, block + 1, run_end - (block + 1));
+        }
+
+        heap_take_free_blocks(heap, block, 1, false);
+        heap_mark_blocks_taken(heap, block, 1);
+        return block;
+    }
+
+    return -ENOMEM;
+}
+
+void heap_release_zeroed_block(struct heap* heap, int block)
+{
+    heap->table->entries[block] = HEAP_BLOCK_TABLE_ENTRY_FREE | HEAP_BLOCK_IS_ZERO;
+    heap_free_run_coalesce(heap, block, 1);
+}
+
+static bool heap_resize_in_place(struct heap* heap, int start_block, uint32_t old_blocks, uint32_t new_blocks)
+{
+    struct heap_table* table = heap->table;
+    if (new_blocks < old_blocks)
+    {
+        // Release the trailing blocks, they can only merge with a free run after us
+        uint32_t released_block = start_block + new_blocks;
+        heap_mark_blocks_taken(heap, start_block, new_blocks);
+        memset(&table->entries[released_block], HEAP_BLOCK_TABLE_ENTRY_FREE, old_blocks - new_blocks);
+        heap_free_run_coalesce(heap, released_block, old_blocks - new_blocks);
+        heap->stats.blocks_used -= old_blocks - new_blocks;
+        heap->dirty_free_blocks += old_blocks - new_blocks;
+        return true;
+    }
+
+    uint32_t extra_blocks = new_blocks - old_blocks;
+    uint32_t right_block = start_block + old_blocks;
+    if (right_block >= table->total || heap_get_entry_type(table->entries[right_block]) != HEAP_BLOCK_TABLE_ENTRY_FREE)
+    {
+        return false;
+    }
+
+    uint32_t run_size = table->nodes[right_block].size;
+    if (run_size < extra_blocks)
+    {
+        return false;
+    }
+
+    // Grow into the free run that follows us
+    heap_free_run_remove(heap, right_block);
+    if (run_size > extra_blocks)
+    {
+        heap_free_run_insert(heap, right_block + extra_blocks, run_size - extra_blocks);
+    }
+
+    heap_take_free_blocks(heap, right_block, extra_blocks, false);
+    heap_mark_blocks_taken(heap, start_block, new_blocks);
+    heap->stats.blocks_used += extra_blocks;
+    if (heap->stats.blocks_used > heap->stats.blocks_high_water)
+    {
+        heap->stats.blocks_high_water = heap->stats.blocks_used;
+    }
+    return true;
+}
+
+void* heap_realloc(struct heap* heap, void* ptr, size_t size)
+{
+    if (!ptr)
+    {
+        return heap_malloc(heap, size);
+    }
+
+    if (size == 0)
+    {
+        heap_free(heap, ptr);
+        return 0;
+    }
+
+    size_t old_size = heap_allocation_size(heap, ptr);
+    uint32_t old_blocks = old_size / OS_HEAP_BLOCK_SIZE;
+    uint32_t new_blocks = heap_align_value_to_upper(size) / OS_HEAP_BLOCK_SIZE;
+    if (new_blocks == old_blocks)
+    {
+        return ptr;
+    }
+
+    int start_block = heap_address_to_block(heap, ptr);
+    bool resized = false;
+    if (heap->type == HEAP_TYPE_BUDDY)
+    {
+        resized = heap_buddy_resize_in_place(heap, start_block, new_blocks);
+    }
+    else
+    {
+        resized = heap_resize_in_place(heap, start_block, old_blocks, new_blocks);
+    }
+
+    if (resized)
+    {
+        return ptr;
+    }
+
+    // No room to grow where we are, move the allocation
+    void* new_ptr = heap_malloc(heap, size);
+    if (!new_ptr)
+    {
+        return 0;
+    }
+
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+    heap_free(heap, ptr);
+    return new_ptr;
+}
+
+size_t heap_allocation_size(struct heap* heap, void* ptr)
+{
+    struct heap_table* table = heap->table;
+    int block = heap_address_to_block(heap, ptr);
+    if (heap->type == HEAP_TYPE_BUDDY)
+    {
+        return table->nodes[block].size * OS_HEAP_BLOCK_SIZE;
+    }
+
+    size_t total_blocks = 1;
+    while (table->entries[block] & HEAP_BLOCK_HAS_NEXT)
+    {
+        block++;
+        total_blocks++;
+    }
+
+    return total_blocks * OS_HEAP_BLOCK_SIZE;
+}
+
+uint32_t heap_largest_free_run(struct heap* heap)
+{
+    if (!heap->free_classes)
+    {
+        return 0;
+    }
+
+    // Only the highest populated class can hold the largest run
+    int class = 31 - __builtin_clz(heap->free_classes);
+    uint32_t largest = 0;
+    uint32_t block = heap->free_heads[class];
+    while (block != HEAP_NO_BLOCK)
+    {
+        if (heap->table->nodes[block].size > largest)
+        {
+            largest = heap->table->nodes[block].size;
+        }
+        block = heap->table->nodes[block].next;
+    }
+
+    return largest;
+}
@@ -9,26 +9,96 @@
 
 #define HEAP_BLOCK_HAS_NEXT 0b10000000
 #define HEAP_BLOCK_IS_FIRST  0b01000000
+// Set on free blocks whose memory is known to be all zero
+#define HEAP_BLOCK_IS_ZERO   0b00100000
 
+// The heap may write to free blocks to keep a pool of zeroed memory
+#define HEAP_FLAG_ZERO_POOL 0b00000001
+
+
+// Free runs are kept in lists segregated by floor(log2(run length))
+#define HEAP_FREE_CLASSES 32
+#define HEAP_NO_BLOCK 0xFFFFFFFF
+
+// How many runs of the exact size class are tried before splitting a larger run
+#define HEAP_FREE_SCAN_LIMIT 16
 
 typedef unsigned char HEAP_BLOCK_TABLE_ENTRY;
 
+typedef unsigned int HEAP_TYPE;
+
+// First fit over the block table with indexed free runs
+#define HEAP_TYPE_TABLE 0
+// Binary buddy system over the same block table
+#define HEAP_TYPE_BUDDY 1
+
+// Free run bookkeeping, only valid on the first and last block of a free run
+struct heap_free_node
+{
+    // Total blocks in the run
+    uint32_t size;
+    uint32_t next;
+    uint32_t prev;
+};
+
 struct heap_table
 {
     HEAP_BLOCK_TABLE_ENTRY* entries;
+
+    // One node per block, used to index the free runs
+    struct heap_free_node* nodes;
     size_t total;
 };
 
 
+struct heap_stats
+{
+    uint32_t blocks_used;
+    uint32_t blocks_high_water;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failed_allocations;
+};
+
 struct heap
 {
+    HEAP_TYPE type;
+    uint32_t flags;
     struct heap_table* table;
 
     // Start address of the heap data pool
     void* saddr;
+
+    // First free run of every size class, for the buddy backend class n holds blocks of order n
+    uint32_t free_heads[HEAP_FREE_CLASSES];
+
+    // Bit n is set when free_heads[n] is not empty
+    uint32_t free_classes;
+
+    struct heap_stats stats;
+
+    // Free blocks without HEAP_BLOCK_IS_ZERO, where the idle zeroing left off and the first
+    // block of the free run it was in
+    uint32_t dirty_free_blocks;
+    uint32_t zero_cursor;
+    uint32_t zero_run;
 };
 
-int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* table);
+int heap_create(struct heap* heap, HEAP_TYPE type, void* ptr, void* end, struct heap_table* table);
 void* heap_malloc(struct heap* heap, size_t size);
 void heap_free(struct heap* heap, void* ptr);
+void* heap_realloc(struct heap* heap, void* ptr, size_t size);
+void* heap_zalloc(struct heap* heap, size_t size);
+int heap_claim_dirty_block(struct heap* heap);
+void heap_release_zeroed_block(struct heap* heap, int block);
+
+size_t heap_allocation_size(struct heap* heap, void* ptr);
+uint32_t heap_largest_free_run(struct heap* heap);
+
+void heap_stats_allocated(struct heap* heap, uint32_t total_blocks);
+void heap_stats_freed(struct heap* heap, uint32_t total_blocks);
+void heap_free_run_insert(struct heap* heap, uint32_t start_block, uint32_t total_blocks);
+void heap_free_run_remove(struct heap* heap, uint32_t start_block);
+void* heap_block_to_address(struct heap* heap, int block);
+int heap_address_to_block(struct heap* heap, void* address);
 #endif
\ No newline at end of file
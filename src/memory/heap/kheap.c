@@ -1,43 +1,410 @@
 #include "kheap.h"
 #include "heap.h"
+#include "slab.h"
 #include "config.h"
 #include "kernel.h"
 #include "memory/memory.h"
+#include "cpu/cpu.h"
 
 struct heap kernel_heap;
 struct heap_table kernel_heap_table;
+struct slab_allocator kernel_slab;
 
-void kheap_init()
+// Guards kernel_heap, the slab caches and the profiling tables. Interrupt handlers allocate
+// too, so it is always taken with interrupts disabled
+static SPINLOCK kernel_heap_lock = 0;
+
+// Bytes and calls are counted per processor so the slab fast path writes no shared state
+struct kheap_cpu
+{
+    size_t bytes_used;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failed_allocations;
+} __attribute__((aligned(64)));
+
+static struct kheap_cpu kernel_heap_cpus[OS_MAX_CPUS];
+static size_t kernel_bytes_high_water = 0;
+
+#if OS_KHEAP_PROFILING
+// Marks a tracking slot whose allocation has been freed
+#define KHEAP_PROFILE_TOMBSTONE ((void*) 1)
+
+struct kheap_profile_allocation
+{
+    void* ptr;
+    int site;
+};
+
+static struct kheap_profile_site kheap_profile_sites[OS_KHEAP_PROFILE_MAX_SITES];
+static struct kheap_profile_allocation kheap_profile_allocations[OS_KHEAP_PROFILE_MAX_TRACKED];
+
+static int kheap_profile_get_site(void* caller)
+{
+    for (int i = 0; i < OS_KHEAP_PROFILE_MAX_SITES; i++)
+    {
+        struct kheap_profile_site* site = &kheap_profile_sites[i];
+        if (site->caller == caller)
+        {
+            return i;
+        }
+
+        if (site->caller == 0)
+        {
+            site->caller = caller;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static struct kheap_profile_allocation* kheap_profile_slot(void* ptr, bool insert)
+{
+    uint32_t index = ((uint32_t) ptr >> 4) % OS_KHEAP_PROFILE_MAX_TRACKED;
+    for (int i = 0; i < OS_KHEAP_PROFILE_MAX_TRACKED; i++)
+    {
+        struct kheap_profile_allocation* slot = &kheap_profile_allocations[index];
+        if (slot->ptr == ptr || slot->ptr == 0 || (insert && slot->ptr == KHEAP_PROFILE_TOMBSTONE))
+        {
+            return slot->ptr == 0 && !insert ? 0 : slot;
+        }
+
+        index = (index + 1) % OS_KHEAP_PROFILE_MAX_TRACKED;
+    }
+
+    return 0;
+}
+
+static void kheap_profile_allocated(void* ptr, size_t size, void* caller)
+{
+    int site_index = kheap_profile_get_site(caller);
+    if (site_index < 0)
+    {
+        return;
+    }
+
+    struct kheap_profile_site* site = &kheap_profile_sites[site_index];
+    site->allocations++;
+    site->total_bytes += size;
+
+    struct kheap_profile_allocation* slot = kheap_profile_slot(ptr, true);
+    if (!slot)
+    {
+        return;
+    }
+
+    slot->ptr = ptr;
+    slot->site = site_index;
+    site->live_allocations++;
+    site->live_bytes += size;
+}
+
+static void kheap_profile_freed(void* ptr, size_t size)
+{
+    struct kheap_profile_allocation* slot = kheap_profile_slot(ptr, false);
+    if (!slot || slot->ptr != ptr)
+    {
+        return;
+    }
+
+    struct kheap_profile_site* site = &kheap_profile_sites[slot->site];
+    site->live_allocations--;
+    site->live_bytes -= size;
+    slot->ptr = KHEAP_PROFILE_TOMBSTONE;
+}
+#endif
+
+void kheap_init(void* start, void* end)
 {
-    int total_table_entries = OS_HEAP_SIZE_BYTES / OS_HEAP_BLOCK_SIZE;
-    kernel_heap_table.entries = (HEAP_BLOCK_TABLE_ENTRY*)(OS_HEAP_TABLE_ADDRESS);
+    // The block table and its free run index are carved from the front of the region
+    uint32_t metadata_per_block = sizeof(HEAP_BLOCK_TABLE_ENTRY) + sizeof(struct heap_free_node);
+    uint32_t total_table_entries = (end - start) / (OS_HEAP_BLOCK_SIZE + metadata_per_block);
+    uint32_t metadata_size = total_table_entries * metadata_per_block;
+    void* heap_start = start + metadata_size;
+    if ((uint32_t) heap_start % OS_HEAP_BLOCK_SIZE)
+    {
+        heap_start += OS_HEAP_BLOCK_SIZE - ((uint32_t) heap_start % OS_HEAP_BLOCK_SIZE);
+    }
+
+    if ((uint32_t)(end - heap_start) / OS_HEAP_BLOCK_SIZE < total_table_entries)
+    {
+        total_table_entries = (end - heap_start) / OS_HEAP_BLOCK_SIZE;
+    }
+
+    kernel_heap_table.nodes = (struct heap_free_node*) start;
+    kernel_heap_table.entries = (HEAP_BLOCK_TABLE_ENTRY*)(start + (total_table_entries * sizeof(struct heap_free_node)));
     kernel_heap_table.total = total_table_entries;
 
-    void* end = (void*)(OS_HEAP_ADDRESS + OS_HEAP_SIZE_BYTES);
-    int res = heap_create(&kernel_heap, (void*)(OS_HEAP_ADDRESS), end, &kernel_heap_table);
+    void* heap_end = heap_start + (total_table_entries * OS_HEAP_BLOCK_SIZE);
+    int res = heap_create(&kernel_heap, OS_HEAP_TYPE, heap_start, heap_end, &kernel_heap_table);
     if (res < 0)
     {
         print("Failed to create heap\n");
     }
+    kernel_heap.flags |= HEAP_FLAG_ZERO_POOL;
 
+    slab_init(&kernel_slab, &kernel_heap, &kernel_heap_lock);
 }
 
-void* kmalloc(size_t size)
+static size_t kheap_bytes_used()
 {
-    return heap_malloc(&kernel_heap, size);
+    size_t total = 0;
+    for (int i = 0; i < OS_MAX_CPUS; i++)
+    {
+        total += kernel_heap_cpus[i].bytes_used;
+    }
+
+    return total;
 }
 
-void* kzalloc(size_t size)
+// Interrupt handlers allocate too, so one must not land in the middle of the update
+static void kheap_count(size_t bytes, uint32_t allocations, uint32_t frees, uint32_t failed_allocations)
+{
+    uint32_t flags = cpu_save_interrupts();
+    struct kheap_cpu* cpu = &kernel_heap_cpus[cpu_current_id()];
+    cpu->bytes_used += bytes;
+    cpu->allocations += allocations;
+    cpu->frees += frees;
+    cpu->failed_allocations += failed_allocations;
+    cpu_restore_interrupts(flags);
+}
+
+// Only sampled on the locked paths, so short peaks served from magazines can be missed
+static void kheap_update_high_water()
 {
-    void* ptr = kmalloc(size);
+    size_t bytes_used = kheap_bytes_used();
+    if (bytes_used > kernel_bytes_high_water)
+    {
+        kernel_bytes_high_water = bytes_used;
+    }
+}
+
+static size_t kheap_allocation_size(void* ptr)
+{
+    if (slab_owns(ptr))
+    {
+        return slab_object_size(ptr);
+    }
+
+    uint32_t flags = spin_lock_irqsave(&kernel_heap_lock);
+    size_t size = heap_allocation_size(&kernel_heap, ptr);
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+    return size;
+}
+
+static void* kheap_malloc(size_t size, bool zero, void* caller)
+{
+    uint32_t flags;
+    void* ptr = 0;
+    if (size <= OS_SLAB_MAX_SIZE)
+    {
+        ptr = slab_malloc(&kernel_slab, size);
+        if (ptr && zero)
+        {
+            memset(ptr, 0x00, size);
+        }
+    }
+    else
+    {
+        flags = spin_lock_irqsave(&kernel_heap_lock);
+        ptr = zero ? heap_zalloc(&kernel_heap, size) : heap_malloc(&kernel_heap, size);
+        spin_unlock_irqrestore(&kernel_heap_lock, flags);
+    }
+
     if (!ptr)
+    {
+        kheap_count(0, 0, 0, 1);
         return 0;
+    }
+
+    size_t allocated = kheap_allocation_size(ptr);
+    kheap_count(allocated, 1, 0, 0);
+    if (size > OS_SLAB_MAX_SIZE)
+    {
+        kheap_update_high_water();
+    }
 
-    memset(ptr, 0x00, size);
+#if OS_KHEAP_PROFILING
+    flags = spin_lock_irqsave(&kernel_heap_lock);
+    kheap_profile_allocated(ptr, allocated, caller);
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+#endif
     return ptr;
 }
 
+void* kmalloc(size_t size)
+{
+    return kheap_malloc(size, false, __builtin_return_address(0));
+}
+
+void* kzalloc(size_t size)
+{
+    return kheap_malloc(size, true, __builtin_return_address(0));
+}
+
 void kfree(void* ptr)
 {
+    uint32_t flags;
+    if (!ptr)
+        return;
+
+    size_t allocated = kheap_allocation_size(ptr);
+    kheap_count(-allocated, 0, 1, 0);
+#if OS_KHEAP_PROFILING
+    flags = spin_lock_irqsave(&kernel_heap_lock);
+    kheap_profile_freed(ptr, allocated);
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+#endif
+
+    if (slab_owns(ptr))
+    {
+        slab_free(&kernel_slab, ptr);
+        return;
+    }
+
+    flags = spin_lock_irqsave(&kernel_heap_lock);
     heap_free(&kernel_heap, ptr);
-}
\ No newline at end of file
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+}
+
+void* krealloc(void* ptr, size_t size)
+{
+    void* caller = __builtin_return_address(0);
+    if (!ptr)
+    {
+        return kheap_malloc(size, false, caller);
+    }
+
+    if (size == 0)
+    {
+        kfree(ptr);
+        return 0;
+    }
+
+    size_t old_size = kheap_allocation_size(ptr);
+    if (slab_owns(ptr))
+    {
+        // Stay in the same object if it still fits and is not mostly wasted
+        if (size <= old_size && (size > old_size / 2 || old_size == OS_SLAB_MIN_SIZE))
+        {
+            return ptr;
+        }
+
+        void* new_ptr = kheap_malloc(size, false, caller);
+        if (!new_ptr)
+        {
+            return 0;
+        }
+
+        memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        kfree(ptr);
+        return new_ptr;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&kernel_heap_lock);
+    void* new_ptr = heap_realloc(&kernel_heap, ptr, size);
+    size_t new_size = new_ptr ? heap_allocation_size(&kernel_heap, new_ptr) : 0;
+#if OS_KHEAP_PROFILING
+    if (new_ptr)
+    {
+        kheap_profile_freed(ptr, old_size);
+        kheap_profile_allocated(new_ptr, new_size, caller);
+    }
+#endif
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+
+    if (!new_ptr)
+    {
+        kheap_count(0, 0, 0, 1);
+        return 0;
+    }
+
+    kheap_count(new_size - old_size, 1, 1, 0);
+    kheap_update_high_water();
+    return new_ptr;
+}
+
+void kheap_idle()
+{
+    for (int i = 0; i < OS_HEAP_IDLE_ZERO_BLOCKS; i++)
+    {
+        uint32_t flags = spin_lock_irqsave(&kernel_heap_lock);
+        int block = heap_claim_dirty_block(&kernel_heap);
+        spin_unlock_irqrestore(&kernel_heap_lock, flags);
+        if (block < 0)
+        {
+            break;
+        }
+
+        // The block is out of the free runs, so it can be cleared without the lock held
+        memset(heap_block_to_address(&kernel_heap, block), 0x00, OS_HEAP_BLOCK_SIZE);
+
+        flags = spin_lock_irqsave(&kernel_heap_lock);
+        heap_release_zeroed_block(&kernel_heap, block);
+        spin_unlock_irqrestore(&kernel_heap_lock, flags);
+    }
+}
+
+void kheap_get_stats(struct kheap_stats* stats)
+{
+    struct heap_stats* heap_stats = &kernel_heap.stats;
+    memset(stats, 0, sizeof(struct kheap_stats));
+    uint32_t flags = spin_lock_irqsave(&kernel_heap_lock);
+    kheap_update_high_water();
+    stats->bytes_used = kheap_bytes_used();
+    stats->bytes_high_water = kernel_bytes_high_water;
+    stats->blocks_total = kernel_heap_table.total;
+    stats->blocks_used = heap_stats->blocks_used;
+    stats->blocks_high_water = heap_stats->blocks_high_water;
+    stats->largest_free_blocks = heap_largest_free_run(&kernel_heap);
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+
+    for (int i = 0; i < OS_MAX_CPUS; i++)
+    {
+        stats->allocations += kernel_heap_cpus[i].allocations;
+        stats->frees += kernel_heap_cpus[i].frees;
+        stats->failed_allocations += kernel_heap_cpus[i].failed_allocations;
+    }
+
+    uint32_t free_blocks = stats->blocks_total - stats->blocks_used;
+    if (free_blocks)
+    {
+        stats->fragmentation_percent = 100 - (stats->largest_free_blocks * 100) / free_blocks;
+    }
+}
+
+int kheap_profile_top_sites(struct kheap_profile_site* sites, int max)
+{
+    int total = 0;
+#if OS_KHEAP_PROFILING
+    uint32_t flags = spin_lock_irqsave(&kernel_heap_lock);
+
+    // Insertion sort the known sites by live bytes, largest first
+    for (int i = 0; i < OS_KHEAP_PROFILE_MAX_SITES && kheap_profile_sites[i].caller; i++)
+    {
+        struct kheap_profile_site* site = &kheap_profile_sites[i];
+        int pos = total;
+        while (pos > 0 && sites[pos - 1].live_bytes < site->live_bytes)
+        {
+            if (pos < max)
+            {
+                sites[pos] = sites[pos - 1];
+            }
+            pos--;
+        }
+
+        if (pos < max)
+        {
+            sites[pos] = *site;
+            if (total < max)
+            {
+                total++;
+            }
+        }
+    }
+
+    spin_unlock_irqrestore(&kernel_heap_lock, flags);
+#endif
+    return total;
+}
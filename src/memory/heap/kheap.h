@@ -4,9 +4,48 @@
 #include <stdint.h>
 #include<stddef.h>
 
-void kheap_init();
+struct kheap_stats
+{
+    // Bytes handed out to callers, rounded up to slab class or block size
+    size_t bytes_used;
+
+    // Sampled on the slow paths only, slab bursts inside a magazine can be missed
+    size_t bytes_high_water;
+
+    uint32_t blocks_total;
+    uint32_t blocks_used;
+    uint32_t blocks_high_water;
+
+    // Counted at kmalloc, kzalloc, krealloc and kfree, whether the slabs or the heap served them
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failed_allocations;
+
+    // Largest run of free blocks that a single allocation could still get
+    uint32_t largest_free_blocks;
+
+    // 0 when all free memory is one run, approaching 100 as it is scattered
+    uint32_t fragmentation_percent;
+};
+
+struct kheap_profile_site
+{
+    // Return address of the kmalloc/kzalloc call
+    void* caller;
+    uint32_t allocations;
+    uint32_t live_allocations;
+    size_t total_bytes;
+    size_t live_bytes;
+};
+
+void kheap_init(void* start, void* end);
 void* kmalloc(size_t size);
 void kfree(void* ptr);
 void* kzalloc(size_t size);
+void* krealloc(void* ptr, size_t size);
+void kheap_idle();
+
+void kheap_get_stats(struct kheap_stats* stats);
+int kheap_profile_top_sites(struct kheap_profile_site* sites, int max);
 
-#endif
\ No newline at end of file
+#endif
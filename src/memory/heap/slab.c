@@ -0,0 +1,231 @@
+#include "slab.h"
+#include "heap.h"
+#include "kernel.h"
+#include "memory/memory.h"
+
+// Objects start after the slab header, rounded up so they stay 16 byte aligned
+#define SLAB_OBJECTS_OFFSET ((sizeof(struct slab) + 15) & ~15)
+
+static int slab_class_for_size(size_t size)
+{
+    int index = 0;
+    size_t class_size = OS_SLAB_MIN_SIZE;
+    while (class_size < size)
+    {
+        class_size <<= 1;
+        index++;
+    }
+
+    return index;
+}
+
+void slab_init(struct slab_allocator* allocator, struct heap* heap, SPINLOCK* lock)
+{
+    memset(allocator, 0, sizeof(struct slab_allocator));
+    allocator->heap = heap;
+    allocator->lock = lock;
+
+    size_t size = OS_SLAB_MIN_SIZE;
+    for (int i = 0; i < OS_SLAB_TOTAL_CLASSES; i++)
+    {
+        allocator->caches[i].object_size = size;
+        size <<= 1;
+    }
+}
+
+static void slab_list_add(struct slab_cache* cache, struct slab* slab)
+{
+    slab->prev = 0;
+    slab->next = cache->partial;
+    if (cache->partial)
+    {
+        cache->partial->prev = slab;
+    }
+    cache->partial = slab;
+}
+
+static void slab_list_remove(struct slab_cache* cache, struct slab* slab)
+{
+    if (slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        cache->partial = slab->next;
+    }
+
+    if (slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->next = 0;
+    slab->prev = 0;
+}
+
+static struct slab* slab_new(struct slab_allocator* allocator, struct slab_cache* cache)
+{
+    struct slab* slab = heap_malloc(allocator->heap, OS_HEAP_BLOCK_SIZE);
+    if (!slab)
+    {
+        return 0;
+    }
+
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->next = 0;
+    slab->prev = 0;
+    slab->in_use = 0;
+    slab->total = (OS_HEAP_BLOCK_SIZE - SLAB_OBJECTS_OFFSET) / cache->object_size;
+
+    // Thread every object onto the free list
+    char* object = (char*) slab + SLAB_OBJECTS_OFFSET;
+    slab->free = 0;
+    for (int i = slab->total - 1; i >= 0; i--)
+    {
+        void** current = (void**)(object + (i * cache->object_size));
+        *current = slab->free;
+        slab->free = current;
+    }
+
+    slab_list_add(cache, slab);
+    return slab;
+}
+
+static void* slab_cache_alloc(struct slab_allocator* allocator, struct slab_cache* cache)
+{
+    struct slab* slab = cache->partial;
+    if (!slab)
+    {
+        slab = slab_new(allocator, cache);
+        if (!slab)
+        {
+            return 0;
+        }
+    }
+
+    void** object = slab->free;
+    slab->free = *object;
+    slab->in_use++;
+
+    // Full slabs leave the partial list until an object is returned
+    if (!slab->free)
+    {
+        slab_list_remove(cache, slab);
+    }
+
+    return object;
+}
+
+static struct slab* slab_from_ptr(void* ptr)
+{
+    return (struct slab*)((uint32_t) ptr & ~(OS_HEAP_BLOCK_SIZE - 1));
+}
+
+bool slab_owns(void* ptr)
+{
+    // Heap allocations are always block aligned, slab objects never are
+    if (((uint32_t) ptr % OS_HEAP_BLOCK_SIZE) == 0)
+    {
+        return false;
+    }
+
+    return slab_from_ptr(ptr)->magic == SLAB_MAGIC;
+}
+
+size_t slab_object_size(void* ptr)
+{
+    return slab_from_ptr(ptr)->cache->object_size;
+}
+
+static void slab_cache_free(struct slab_allocator* allocator, void* ptr)
+{
+    struct slab* slab = slab_from_ptr(ptr);
+    struct slab_cache* cache = slab->cache;
+    bool was_full = slab->free == 0;
+
+    void** object = ptr;
+    *object = slab->free;
+    slab->free = object;
+    slab->in_use--;
+
+    if (was_full)
+    {
+        slab_list_add(cache, slab);
+    }
+
+    // Give empty slabs back to the heap, but keep one around to avoid thrashing
+    if (slab->in_use == 0 && (slab->next || slab->prev))
+    {
+        slab_list_remove(cache, slab);
+        slab->magic = 0;
+        heap_free(allocator->heap, slab);
+    }
+}
+
+void* slab_malloc(struct slab_allocator* allocator, size_t size)
+{
+    if (size > OS_SLAB_MAX_SIZE)
+    {
+        return 0;
+    }
+
+    // The magazines are only shared with interrupt handlers on this processor, so keeping
+    // interrupts off is enough until the shared caches are touched under the lock
+    void* object = 0;
+    uint32_t flags = cpu_save_interrupts();
+    int class = slab_class_for_size(size);
+    struct slab_magazine* magazine = &allocator->cpus[cpu_current_id()].magazines[class];
+    if (magazine->rounds == 0)
+    {
+        // Refill half a magazine so the next frees do not have to drain straight away
+        struct slab_cache* cache = &allocator->caches[class];
+        spin_lock(allocator->lock);
+        while (magazine->rounds < OS_SLAB_MAGAZINE_SIZE / 2)
+        {
+            void* refill = slab_cache_alloc(allocator, cache);
+            if (!refill)
+            {
+                break;
+            }
+            magazine->objects[magazine->rounds++] = refill;
+        }
+        spin_unlock(allocator->lock);
+    }
+
+    if (magazine->rounds > 0)
+    {
+        object = magazine->objects[--magazine->rounds];
+    }
+
+    cpu_restore_interrupts(flags);
+    return object;
+}
+
+void slab_free(struct slab_allocator* allocator, void* ptr)
+{
+    struct slab* slab = slab_from_ptr(ptr);
+    int class = slab_class_for_size(slab->cache->object_size);
+    uint32_t flags = cpu_save_interrupts();
+    struct slab_magazine* magazine = &allocator->cpus[cpu_current_id()].magazines[class];
+    if (magazine->rounds == OS_SLAB_MAGAZINE_SIZE)
+    {
+        // Drain the older half back to the shared caches
+        spin_lock(allocator->lock);
+        for (int i = 0; i < OS_SLAB_MAGAZINE_SIZE / 2; i++)
+        {
+            slab_cache_free(allocator, magazine->objects[i]);
+        }
+        spin_unlock(allocator->lock);
+
+        for (int i = OS_SLAB_MAGAZINE_SIZE / 2; i < OS_SLAB_MAGAZINE_SIZE; i++)
+        {
+            magazine->objects[i - (OS_SLAB_MAGAZINE_SIZE / 2)] = magazine->objects[i];
+        }
+        magazine->rounds -= OS_SLAB_MAGAZINE_SIZE / 2;
+    }
+
+    magazine->objects[magazine->rounds++] = ptr;
+    cpu_restore_interrupts(flags);
+}
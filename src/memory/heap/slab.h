@@ -0,0 +1,69 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "config.h"
+#include "heap.h"
+#include "cpu/cpu.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SLAB_MAGIC 0x51AB51AB
+
+struct slab_cache;
+
+// Header stored at the start of every heap block that is carved into objects
+struct slab
+{
+    uint32_t magic;
+    struct slab_cache* cache;
+
+    // Linked list of slabs in the cache that still have free objects
+    struct slab* next;
+    struct slab* prev;
+
+    // Singly linked list of free objects inside this slab
+    void* free;
+    uint16_t in_use;
+    uint16_t total;
+};
+
+struct slab_cache
+{
+    size_t object_size;
+
+    // Slabs with at least one free object
+    struct slab* partial;
+};
+
+// A processor local stack of free objects from one slab class
+struct slab_magazine
+{
+    uint32_t rounds;
+    void* objects[OS_SLAB_MAGAZINE_SIZE];
+};
+
+// Aligned so processors never share a cache line with each other's magazines
+struct slab_cpu
+{
+    struct slab_magazine magazines[OS_SLAB_TOTAL_CLASSES];
+} __attribute__((aligned(64)));
+
+struct slab_allocator
+{
+    // The heap that slab pages are taken from
+    struct heap* heap;
+
+    // Guards the caches and the heap, only taken to refill or drain a magazine
+    SPINLOCK* lock;
+    struct slab_cache caches[OS_SLAB_TOTAL_CLASSES];
+    struct slab_cpu cpus[OS_MAX_CPUS];
+};
+
+void slab_init(struct slab_allocator* allocator, struct heap* heap, SPINLOCK* lock);
+void* slab_malloc(struct slab_allocator* allocator, size_t size);
+void slab_free(struct slab_allocator* allocator, void* ptr);
+bool slab_owns(void* ptr);
+size_t slab_object_size(void* ptr);
+
+#endif
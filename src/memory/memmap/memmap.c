@@ -0,0 +1,116 @@
+#include "memmap.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+
+#define MEMMAP_PAGE_SIZE 4096
+
+/**
+ * Finds the largest page aligned range of usable memory between min_address and max_address
+ * that no other entry of the map marks as reserved.
+ */
+int memmap_find_largest_region(struct memmap* map, uint32_t min_address, uint32_t max_address, struct memmap_region* region)
+{
+    uint64_t best_start = 0;
+    uint64_t best_end = 0;
+    if (!map || map->total == 0 || map->total > OS_MEMORY_MAP_MAX_ENTRIES)
+    {
+        return -EINVARG;
+    }
+
+    for (uint32_t i = 0; i < map->total; i++)
+    {
+        struct memmap_entry* entry = &map->entries[i];
+        if (entry->type != MEMMAP_TYPE_USABLE)
+        {
+            continue;
+        }
+
+        uint64_t start = entry->base < min_address ? min_address : entry->base;
+        uint64_t end = entry->base + entry->length;
+        if (end > max_address)
+        {
+            end = max_address;
+        }
+
+        // Firmware maps may overlap, never hand out anything another entry reserves
+        for (uint32_t j = 0; j < map->total && start < end; j++)
+        {
+            struct memmap_entry* other = &map->entries[j];
+            uint64_t other_end = other->base + other->length;
+            if (other->type == MEMMAP_TYPE_USABLE || other_end <= start || other->base >= end)
+            {
+                continue;
+            }
+
+            if (other->base > start)
+            {
+                end = other->base;
+            }
+            else
+            {
+                start = other_end;
+            }
+        }
+
+        start = (start + MEMMAP_PAGE_SIZE - 1) & ~((uint64_t) MEMMAP_PAGE_SIZE - 1);
+        end &= ~((uint64_t) MEMMAP_PAGE_SIZE - 1);
+        if (start < end && (end - start) > (best_end - best_start))
+        {
+            best_start = start;
+            best_end = end;
+        }
+    }
+
+    if (best_start == best_end)
+    {
+        return -ENOMEM;
+    }
+
+    region->start = (void*)(uint32_t) best_start;
+    region->end = (void*)(uint32_t) best_end;
+    return 0;
+}
+
+/**
+ * Splits the usable memory above OS_HEAP_ADDRESS between the kernel heap and the frame pool.
+ * Falls back to the fixed layout in config.h only when the bootloader gave us no map at all.
+ */
+void memmap_get_kernel_regions(struct memmap* map, struct memmap_region* heap_region, struct memmap_region* frame_region)
+{
+    struct memmap_region region;
+    int res = memmap_find_largest_region(map, OS_HEAP_ADDRESS, OS_MEMORY_MAX_ADDRESS, &region);
+    if (res == -EINVARG)
+    {
+        heap_region->start = (void*) OS_HEAP_ADDRESS;
+        heap_region->end = (void*)(OS_HEAP_ADDRESS + OS_HEAP_SIZE_BYTES);
+        frame_region->start = (void*) OS_FRAME_POOL_ADDRESS;
+        frame_region->end = (void*)(OS_FRAME_POOL_ADDRESS + OS_FRAME_POOL_SIZE_BYTES);
+        return;
+    }
+
+    // The fixed layout needs even more memory, so a map without enough room is the end of the line
+    if (res < 0 || (uint32_t)(region.end - region.start) < OS_MEMORY_MIN_BYTES)
+    {
+        panic("Not enough usable memory above 16MB for the kernel heap and frame pool\n");
+    }
+
+    // The frame pool gets a share of memory but never less than it needs to map 4GB
+    uint32_t total_bytes = region.end - region.start;
+    uint32_t frame_bytes = (total_bytes / 100) * OS_FRAME_POOL_PERCENT;
+    if (frame_bytes < OS_FRAME_POOL_SIZE_BYTES)
+    {
+        frame_bytes = OS_FRAME_POOL_SIZE_BYTES;
+    }
+
+    if (frame_bytes > total_bytes / 2)
+    {
+        frame_bytes = total_bytes / 2;
+    }
+    frame_bytes &= ~(MEMMAP_PAGE_SIZE - 1);
+
+    frame_region->end = region.end;
+    frame_region->start = region.end - frame_bytes;
+    heap_region->start = region.start;
+    heap_region->end = frame_region->start;
+}
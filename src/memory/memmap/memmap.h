@@ -0,0 +1,38 @@
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// E820 address range types
+#define MEMMAP_TYPE_USABLE 1
+#define MEMMAP_TYPE_RESERVED 2
+#define MEMMAP_TYPE_ACPI_RECLAIMABLE 3
+#define MEMMAP_TYPE_ACPI_NVS 4
+#define MEMMAP_TYPE_BAD 5
+
+struct memmap_entry
+{
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi;
+} __attribute__((packed));
+
+// Left by the bootloader at OS_MEMORY_MAP_ADDRESS
+struct memmap
+{
+    uint32_t total;
+    struct memmap_entry entries[];
+} __attribute__((packed));
+
+struct memmap_region
+{
+    void* start;
+    void* end;
+};
+
+int memmap_find_largest_region(struct memmap* map, uint32_t min_address, uint32_t max_address, struct memmap_region* region);
+void memmap_get_kernel_regions(struct memmap* map, struct memmap_region* heap_region, struct memmap_region* frame_region);
+
+#endif
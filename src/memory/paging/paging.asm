@@ -2,7 +2,12 @@
 
 section.asm 
 global paging_load_directory 
-global enable_paging
+global paging_enable_cr4
+global paging_enable_cr0
+global paging_invalidate
+global paging_flush_tlb
+global paging_flush_tlb_global
+global paging_write_pat
 
 paging_load_directory: 
     push ebp 
@@ -12,12 +17,83 @@ paging_load_directory:
     pop ebp
     ret
 
-enable_paging:
+; void paging_enable_cr4(uint32_t bits)
+paging_enable_cr4:
+    push ebp
+    mov ebp,esp
+    mov eax,cr4
+    or eax,[ebp+8]
+    mov cr4,eax
+    pop ebp
+    ret
+
+paging_enable_cr0:
     push ebp
     mov ebp,esp 
+    ; Write protect makes the kernel fault on read only pages too, copy on write relies on it
     mov eax,cr0
-    or eax,0x80000000
+    or eax,0x80010000
     mov cr0,eax
     pop ebp 
-    ret 
+    ret
+
+paging_invalidate:
+    push ebp
+    mov ebp,esp
+    mov eax,[ebp+8]
+    invlpg [eax]
+    pop ebp
+    ret
 
+paging_flush_tlb:
+    mov eax,cr3
+    mov cr3,eax
+    ret
+
+; void paging_write_pat(uint32_t low, uint32_t high)
+; Changes memory types the way the SDM lays out for the MTRRs, so no line cached under the old
+; type survives: caches off and flushed, the MSR written, TLB and caches flushed again
+paging_write_pat:
+    push ebp
+    mov ebp,esp
+    pushfd
+    cli
+    ; No fill cache mode, CD set and NW clear
+    mov eax,cr0
+    push eax
+    or eax,0x40000000
+    and eax,0xdfffffff
+    mov cr0,eax
+    wbinvd
+    ; Global pages are only flushed with CR4.PGE cleared
+    mov eax,cr4
+    push eax
+    and eax,0xffffff7f
+    mov cr4,eax
+    mov eax,cr3
+    mov cr3,eax
+    ; IA32_PAT
+    mov ecx,0x277
+    mov eax,[ebp+8]
+    mov edx,[ebp+12]
+    wrmsr
+    wbinvd
+    mov eax,cr3
+    mov cr3,eax
+    ; Back to the caching and global pages we had
+    pop eax
+    mov cr4,eax
+    pop eax
+    mov cr0,eax
+    popfd
+    pop ebp
+    ret
+
+; Reloading CR3 leaves global pages alone, toggling CR4.PGE flushes those as well
+paging_flush_tlb_global:
+    mov eax,cr4
+    mov ecx,eax
+    and eax,0xffffff7f
+    mov cr4,eax
+    mov cr4,ecx
+    ret
@@ -1,35 +1,343 @@
 #include "paging.h"
 #include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
 #include "status.h"
+#include "kernel.h"
+#include "config.h"
+#include "memory/memory.h"
+#include "cpu/cpu.h"
 void paging_load_directory(uint32_t* directory);
+void paging_enable_cr4(uint32_t bits);
+void paging_enable_cr0();
+void paging_flush_tlb();
+void paging_flush_tlb_global();
+void paging_write_pat(uint32_t low, uint32_t high);
+
+// CR4 bits
+#define PAGING_CR4_PSE 0x00000010
+#define PAGING_CR4_PGE 0x00000080
 
 static uint32_t* current_directory = 0;
+static bool paging_pat_enabled = false;
+static bool paging_global_enabled = false;
+
+// Every address space that has been created and not freed yet
+static struct paging_4gb_chunk* paging_chunks = 0;
+
+/**
+ * Flags of a 4MB directory entry as they would appear in a 4KB table entry, the PAT bit moves
+ * from bit 12 down to bit 7 where the large page bit was
+ */
+static uint32_t paging_large_to_table_flags(uint32_t entry)
+{
+    uint32_t flags = entry & 0xf7f;
+    if (entry & PAGING_LARGE_PAT)
+    {
+        flags |= PAGING_PAT;
+    }
+
+    return flags;
+}
+
+/**
+ * 4MB pages need the processor's page size extensions, without them every directory entry
+ * points at a table of 4KB pages
+ */
+static bool paging_use_large_pages()
+{
+    return OS_PAGING_LARGE_PAGES && cpu_has_feature(CPU_FEATURE_EDX_PSE);
+}
+
+static bool paging_is_kernel_entry(uint32_t directory_index)
+{
+    return directory_index * PAGING_LARGE_PAGE_SIZE < OS_PAGING_GLOBAL_END;
+}
+
+/**
+ * Writes a directory entry. The entries below OS_PAGING_GLOBAL_END map the kernel and must stay
+ * the same in every address space, so a new table or mapping there is written to all of them
+ */
+static void paging_set_directory_entry(uint32_t* directory, uint32_t directory_index, uint32_t entry)
+{
+    directory[directory_index] = entry;
+    if (!paging_is_kernel_entry(directory_index))
+    {
+        return;
+    }
+
+    for (struct paging_4gb_chunk* chunk = paging_chunks; chunk; chunk = chunk->next)
+    {
+        chunk->directory_entry[directory_index] = entry;
+    }
+}
+
+static void paging_add_chunk(struct paging_4gb_chunk* chunk)
+{
+    chunk->next = paging_chunks;
+    paging_chunks = chunk;
+}
+
+static void paging_remove_chunk(struct paging_4gb_chunk* chunk)
+{
+    for (struct paging_4gb_chunk** link = &paging_chunks; *link; link = &(*link)->next)
+    {
+        if (*link == chunk)
+        {
+            *link = chunk->next;
+            return;
+        }
+    }
+}
+
+/**
+ * Creates an address space that identity maps all 4GB. The kernel part is taken over from the
+ * address spaces that already exist so its tables are shared with them, only the first one
+ * builds it with the given flags
+ */
 struct paging_4gb_chunk* paging_new_4gb(uint8_t flags)
 {
-    uint32_t* directory = kzalloc(sizeof(uint32_t) * PAGING_TOTAL_ENTRIES_PER_TABLE);
-    int offset = 0;
+    // Every directory and table entry is written below so the frames need no zeroing
+    uint32_t* directory = frame_alloc();
+    if (!directory)
+    {
+        return 0;
+    }
+
+    struct paging_4gb_chunk* chunk_4gb = kzalloc(sizeof(struct paging_4gb_chunk));
+    if (!chunk_4gb)
+    {
+        frame_free(directory);
+        return 0;
+    }
+
+    bool large_pages = paging_use_large_pages();
+    uint32_t offset = 0;
     for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
     {
-        uint32_t* entry = kzalloc(sizeof(uint32_t) * PAGING_TOTAL_ENTRIES_PER_TABLE);
+        if (paging_chunks && paging_is_kernel_entry(i))
+        {
+            directory[i] = paging_chunks->directory_entry[i];
+            offset += PAGING_LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        // The kernel's own memory is made global and supervisor only with paging_map_kernel
+        uint32_t page_flags = flags;
+        if (large_pages)
+        {
+            // One 4MB page per directory entry, paging_set splits it into a table when needed
+            directory[i] = offset | page_flags | PAGING_IS_LARGE;
+            offset += PAGING_LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        uint32_t* entry = frame_alloc();
+        if (!entry)
+        {
+            panic("paging_new_4gb: Out of frames\n");
+        }
+
         for (int b = 0; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++)
         {
-            entry[b] = (offset + (b * PAGING_PAGE_SIZE)) | flags;
+            entry[b] = (offset + (b * PAGING_PAGE_SIZE)) | page_flags;
         }
-        offset += (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE);
         directory[i] = (uint32_t)entry | flags | PAGING_IS_WRITEABLE;
+        offset += PAGING_LARGE_PAGE_SIZE;
     }
 
-    struct paging_4gb_chunk* chunk_4gb = kzalloc(sizeof(struct paging_4gb_chunk));
     chunk_4gb->directory_entry = directory;
+    paging_add_chunk(chunk_4gb);
     return chunk_4gb;
 }
 
+/**
+ * Shares a page the source chunk owns with its clone and returns the clone's entry, 0 when out of
+ * frames. A writeable page becomes copy on write in the source, a frame whose share count is full
+ * is copied for the clone straight away instead
+ */
+static uint32_t paging_clone_page(uint32_t* source_entry)
+{
+    uint32_t page = *source_entry;
+    void* frame = (void*)(page & 0xfffff000);
+    if (frame_ref(frame) < 0)
+    {
+        void* copy = frame_alloc();
+        if (!copy)
+        {
+            return 0;
+        }
+
+        memcpy(copy, frame, PAGING_PAGE_SIZE);
+        return (uint32_t)copy | (page & 0xfff);
+    }
+
+    if (page & PAGING_IS_WRITEABLE)
+    {
+        page = (page & ~PAGING_IS_WRITEABLE) | PAGING_IS_COW;
+        *source_entry = page;
+    }
+
+    return page;
+}
+
+/**
+ * Creates a copy of an address space without copying any memory. Kernel directory entries are
+ * copied as they are and kept the same in both afterwards, every page the chunk owns is mapped
+ * read only in both chunks and copied on the first write
+ */
+struct paging_4gb_chunk* paging_clone(struct paging_4gb_chunk* chunk)
+{
+    uint32_t* source = chunk->directory_entry;
+    uint32_t* directory = frame_alloc();
+    if (!directory)
+    {
+        return 0;
+    }
+
+    struct paging_4gb_chunk* clone = kzalloc(sizeof(struct paging_4gb_chunk));
+    if (!clone)
+    {
+        frame_free(directory);
+        return 0;
+    }
+    clone->directory_entry = directory;
+
+    bool failed = false;
+    int i = 0;
+    for (i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE && !failed; i++)
+    {
+        uint32_t entry = source[i];
+        directory[i] = entry;
+        if (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE) || ((uint32_t)i * PAGING_LARGE_PAGE_SIZE) < OS_PAGING_GLOBAL_END)
+        {
+            continue;
+        }
+
+        uint32_t* source_table = (uint32_t*)(entry & 0xfffff000);
+        uint32_t* table = frame_alloc();
+        if (!table)
+        {
+            // This entry still points at the source table, which must not be freed with the clone
+            directory[i] = 0;
+            failed = true;
+            break;
+        }
+
+        for (int b = 0; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++)
+        {
+            uint32_t page = source_table[b];
+            if ((page & PAGING_IS_PRESENT) && (page & PAGING_IS_RESERVED))
+            {
+                page = paging_clone_page(&source_table[b]);
+                if (!page)
+                {
+                    // Freeing the clone drops exactly the references taken so far
+                    memset(&table[b], 0, (PAGING_TOTAL_ENTRIES_PER_TABLE - b) * sizeof(uint32_t));
+                    failed = true;
+                    break;
+                }
+            }
+            table[b] = page;
+        }
+        directory[i] = (uint32_t)table | (entry & 0xfff);
+    }
+
+    // Pages of the source that were writeable are read only now
+    if (source == current_directory)
+    {
+        paging_flush_tlb();
+    }
+
+    if (failed)
+    {
+        // Entries not copied yet still point at the source tables and must not be freed
+        for (int b = i; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++)
+        {
+            directory[b] = 0;
+        }
+        paging_free_4gb(clone);
+        return 0;
+    }
+
+    paging_add_chunk(clone);
+    return clone;
+}
+
+/**
+ * Frees an address space along with its tables, frames it owns lose a reference
+ */
+void paging_free_4gb(struct paging_4gb_chunk* chunk)
+{
+    paging_remove_chunk(chunk);
+    uint32_t* directory = chunk->directory_entry;
+    for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    {
+        uint32_t entry = directory[i];
+        if (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE) || ((uint32_t)i * PAGING_LARGE_PAGE_SIZE) < OS_PAGING_GLOBAL_END)
+        {
+            continue;
+        }
+
+        uint32_t* table = (uint32_t*)(entry & 0xfffff000);
+        for (int b = 0; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++)
+        {
+            if ((table[b] & PAGING_IS_PRESENT) && (table[b] & PAGING_IS_RESERVED))
+            {
+                frame_free((void*)(table[b] & 0xfffff000));
+            }
+        }
+        frame_free(table);
+    }
+
+    frame_free(directory);
+    kfree(chunk);
+}
+
+/**
+ * Turns paging on for the directory loaded with paging_switch
+ */
+void enable_paging()
+{
+    // Page size extensions so directory entries can map 4MB pages, they must be on before any
+    // directory built with them is walked
+    if (paging_use_large_pages())
+    {
+        paging_enable_cr4(PAGING_CR4_PSE);
+    }
+
+    paging_enable_cr0();
+
+    // Global pages keep their translations when CR3 is reloaded
+    if (cpu_has_feature(CPU_FEATURE_EDX_PGE))
+    {
+        paging_enable_cr4(PAGING_CR4_PGE);
+        paging_global_enabled = true;
+    }
+}
+
+/**
+ * Identity maps the kernel's own memory between start and end as global and supervisor only, so
+ * its translations survive address space switches and user mode can't reach it. The range is
+ * widened to whole pages
+ */
+int paging_map_kernel(uint32_t* directory, void* start, void* end)
+{
+    uint32_t first = (uint32_t)start & 0xfffff000;
+    uint32_t last = ((uint32_t)end + PAGING_PAGE_SIZE - 1) & 0xfffff000;
+    return paging_map_range(directory, (void*)first, (void*)first, last - first, PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_IS_GLOBAL);
+}
+
 void paging_switch(uint32_t* directory)
 {
     paging_load_directory(directory);
     current_directory = directory;
 }
 
+uint32_t* paging_current_directory()
+{
+    return current_directory;
+}
+
 uint32_t* paging_4gb_chunk_get_directory(struct paging_4gb_chunk* chunk)
 {
     return chunk->directory_entry;
@@ -55,6 +363,45 @@ out:
     return res;
 }
 
+/**
+ * Replaces the 4MB page at directory_index with a table of 4KB pages that map the same memory,
+ * a directory entry that is not present gets a table of entries that are not present either
+ */
+static uint32_t* paging_split_large(uint32_t* directory, uint32_t directory_index)
+{
+    uint32_t entry = directory[directory_index];
+    uint32_t* table = frame_alloc();
+    if (!table)
+    {
+        return 0;
+    }
+
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        // A reserved directory entry passes its reservation on to every page in the table
+        for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+        {
+            table[i] = entry & 0xf7f;
+        }
+        paging_set_directory_entry(directory, directory_index, (uint32_t)table | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL);
+        return table;
+    }
+
+    // The low bits mean the same in both entries except bit 7, which is PAT in a table entry
+    uint32_t base = entry & 0xffc00000;
+    uint32_t flags = paging_large_to_table_flags(entry);
+    for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    {
+        table[i] = (base + (i * PAGING_PAGE_SIZE)) | flags;
+    }
+
+    paging_set_directory_entry(directory, directory_index, (uint32_t)table | (entry & 0x1f) | PAGING_IS_WRITEABLE);
+
+    // The large page may still be cached for any address it covers
+    paging_invalidate((void*)base);
+    return table;
+}
+
 int paging_set(uint32_t* directory, void* virt, uint32_t val)
 {
     if (!paging_is_aligned(virt))
@@ -72,7 +419,391 @@ int paging_set(uint32_t* directory, void* virt, uint32_t val)
 
     uint32_t entry = directory[directory_index];
     uint32_t* table = (uint32_t*)(entry & 0xfffff000);
+    if (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE))
+    {
+        table = paging_split_large(directory, directory_index);
+        if (!table)
+        {
+            return -ENOMEM;
+        }
+    }
+
     table[table_index] = val;
 
     return 0;
-}
\ No newline at end of file
+}
+
+uint32_t paging_get(uint32_t* directory, void* virt)
+{
+    uint32_t directory_index = 0;
+    uint32_t table_index = 0;
+    paging_get_indexes((void*)((uint32_t)virt & 0xfffff000), &directory_index, &table_index);
+
+    uint32_t entry = directory[directory_index];
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        // Holds the reservation flags if the whole 4MB is reserved
+        return entry & 0xf7f;
+    }
+
+    // Report a 4MB page as the 4KB entry it would split into
+    if (entry & PAGING_IS_LARGE)
+    {
+        return ((entry & 0xffc00000) + (table_index * PAGING_PAGE_SIZE)) | paging_large_to_table_flags(entry);
+    }
+
+    uint32_t* table = (uint32_t*)(entry & 0xfffff000);
+    return table[table_index];
+}
+
+/**
+ * Returns the physical address that virt translates to, or zero if it is not mapped
+ */
+void* paging_get_physical_address(uint32_t* directory, void* virt)
+{
+    uint32_t entry = paging_get(directory, virt);
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        return 0;
+    }
+
+    return (void*)((entry & 0xfffff000) | ((uint32_t)virt & 0xfff));
+}
+
+/**
+ * Drops stale translations for a range after its entries changed, page by page for small ranges
+ * and with one full flush once that would take more than OS_PAGING_INVLPG_THRESHOLD pages
+ */
+void paging_invalidate_range(uint32_t* directory, void* virt, size_t size)
+{
+    // Other directories are flushed when paging_switch loads them, except for global kernel pages
+    bool global = (uint32_t)virt < OS_PAGING_GLOBAL_END;
+    if (directory != current_directory && !global)
+    {
+        return;
+    }
+
+    uint32_t total = size / PAGING_PAGE_SIZE;
+    if (total > OS_PAGING_INVLPG_THRESHOLD)
+    {
+        if (global && paging_global_enabled)
+        {
+            paging_flush_tlb_global();
+        }
+        else
+        {
+            paging_flush_tlb();
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < total; i++)
+    {
+        paging_invalidate(virt + (i * PAGING_PAGE_SIZE));
+    }
+}
+
+/**
+ * Maps size bytes at virt to the physical memory at phys. Spans that are 4MB aligned on both
+ * sides are mapped with a single directory entry where no table is in the way
+ */
+int paging_map_range(uint32_t* directory, void* virt, void* phys, size_t size, uint32_t flags)
+{
+    if (!paging_is_aligned(virt) || !paging_is_aligned(phys) || !paging_is_aligned((void*)size))
+    {
+        return -EINVARG;
+    }
+
+    int res = 0;
+    bool large_pages = paging_use_large_pages();
+    uint32_t page = (uint32_t)virt / PAGING_PAGE_SIZE;
+    uint32_t frame = (uint32_t)phys / PAGING_PAGE_SIZE;
+    uint32_t total = size / PAGING_PAGE_SIZE;
+    uint32_t done = 0;
+    while (done < total)
+    {
+        uint32_t directory_index = page / PAGING_TOTAL_ENTRIES_PER_TABLE;
+        uint32_t entry = directory[directory_index];
+        bool whole = large_pages &&
+                     (page % PAGING_TOTAL_ENTRIES_PER_TABLE) == 0 &&
+                     (frame % PAGING_TOTAL_ENTRIES_PER_TABLE) == 0 &&
+                     total - done >= PAGING_TOTAL_ENTRIES_PER_TABLE;
+        if (whole && (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE)))
+        {
+            uint32_t large = (frame * PAGING_PAGE_SIZE) | (flags & 0xf7f) | PAGING_IS_LARGE;
+            if (flags & PAGING_PAT)
+            {
+                large |= PAGING_LARGE_PAT;
+            }
+            paging_set_directory_entry(directory, directory_index, large);
+            page += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            frame += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            done += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            continue;
+        }
+
+        res = paging_set(directory, (void*)(page * PAGING_PAGE_SIZE), (frame * PAGING_PAGE_SIZE) | flags);
+        if (res < 0)
+        {
+            break;
+        }
+        page++;
+        frame++;
+        done++;
+    }
+
+    paging_invalidate_range(directory, virt, done * PAGING_PAGE_SIZE);
+    return res;
+}
+
+/**
+ * Programs PAT entry 4, which pages select with the PAT bit alone, as write combining instead of
+ * write back. Must run before any page is mapped with PAGING_IS_WRITE_COMBINING
+ */
+void paging_init_pat()
+{
+    struct cpu_registers registers;
+    cpu_cpuid(1, &registers);
+    if (!(registers.edx & CPU_FEATURE_EDX_PAT))
+    {
+        return;
+    }
+
+    uint32_t high = 0;
+    uint32_t low = cpu_read_msr(CPU_MSR_PAT, &high);
+    high = (high & 0xffffff00) | PAGING_PAT_TYPE_WRITE_COMBINING;
+    paging_write_pat(low, high);
+    paging_pat_enabled = true;
+}
+
+/**
+ * Maps device memory such as a framebuffer so that stores to it are combined into bursts,
+ * falls back to the default caching when the processor has no PAT
+ */
+int paging_map_write_combining(uint32_t* directory, void* virt, void* phys, size_t size)
+{
+    uint32_t flags = PAGING_IS_PRESENT | PAGING_IS_WRITEABLE;
+    if ((uint32_t)virt < OS_PAGING_GLOBAL_END)
+    {
+        flags |= PAGING_IS_GLOBAL;
+    }
+
+    if (paging_pat_enabled)
+    {
+        flags |= PAGING_IS_WRITE_COMBINING;
+    }
+
+    return paging_map_range(directory, virt, phys, size, flags);
+}
+
+/**
+ * Maps device registers so that every load and store reaches the device in program order
+ */
+int paging_map_uncached(uint32_t* directory, void* virt, void* phys, size_t size)
+{
+    uint32_t flags = PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_CACHE_DISABLED | PAGING_WRITE_THROUGH;
+    if ((uint32_t)virt < OS_PAGING_GLOBAL_END)
+    {
+        flags |= PAGING_IS_GLOBAL;
+    }
+
+    return paging_map_range(directory, virt, phys, size, flags);
+}
+
+/**
+ * Unmaps size bytes at virt. Frames are left to the caller. A table is only freed when the range
+ * covers its whole 4MB, tables that are cleared in part are kept even if nothing is left in them.
+ * Tables below OS_PAGING_GLOBAL_END are shared with every clone of the directory, so they are
+ * cleared in place and never freed
+ */
+void paging_unmap_range(uint32_t* directory, void* virt, size_t size)
+{
+    uint32_t page = (uint32_t)virt / PAGING_PAGE_SIZE;
+    uint32_t total = size / PAGING_PAGE_SIZE;
+    uint32_t done = 0;
+    while (done < total)
+    {
+        uint32_t directory_index = page / PAGING_TOTAL_ENTRIES_PER_TABLE;
+        uint32_t entry = directory[directory_index];
+        bool whole = (page % PAGING_TOTAL_ENTRIES_PER_TABLE) == 0 && total - done >= PAGING_TOTAL_ENTRIES_PER_TABLE;
+        bool shared = (entry & PAGING_IS_PRESENT) && !(entry & PAGING_IS_LARGE) && page * PAGING_PAGE_SIZE < OS_PAGING_GLOBAL_END;
+        if (whole && !shared)
+        {
+            if ((entry & PAGING_IS_PRESENT) && !(entry & PAGING_IS_LARGE))
+            {
+                frame_free((void*)(entry & 0xfffff000));
+            }
+
+            paging_set_directory_entry(directory, directory_index, 0);
+            page += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            done += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            continue;
+        }
+
+        // Nothing is mapped here so there is no need to build a table just to clear it
+        if (entry != 0)
+        {
+            paging_set(directory, (void*)(page * PAGING_PAGE_SIZE), 0);
+        }
+        page++;
+        done++;
+    }
+
+    paging_invalidate_range(directory, virt, size);
+}
+
+/**
+ * Reserves a range of pages without committing any memory to it, each page is given a zeroed
+ * frame the first time it is touched. Any pages already committed in the range must be released first
+ */
+int paging_reserve(uint32_t* directory, void* virt, size_t size, uint8_t flags)
+{
+    if (!paging_is_aligned(virt) || !paging_is_aligned((void*)size))
+    {
+        return -EINVARG;
+    }
+
+    int res = 0;
+    uint32_t reserved = (flags & ~PAGING_IS_PRESENT & 0x1f) | PAGING_IS_RESERVED;
+    uint32_t page = (uint32_t)virt / PAGING_PAGE_SIZE;
+    uint32_t total = size / PAGING_PAGE_SIZE;
+    uint32_t done = 0;
+    while (done < total)
+    {
+        uint32_t directory_index = page / PAGING_TOTAL_ENTRIES_PER_TABLE;
+        uint32_t entry = directory[directory_index];
+
+        // Whole 4MB spans are reserved in the directory and need no table until touched
+        bool whole = (page % PAGING_TOTAL_ENTRIES_PER_TABLE) == 0 && total - done >= PAGING_TOTAL_ENTRIES_PER_TABLE;
+        if (whole && (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE)))
+        {
+            paging_set_directory_entry(directory, directory_index, reserved);
+            page += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            done += PAGING_TOTAL_ENTRIES_PER_TABLE;
+            continue;
+        }
+
+        res = paging_set(directory, (void*)(page * PAGING_PAGE_SIZE), reserved);
+        if (res < 0)
+        {
+            break;
+        }
+        page++;
+        done++;
+    }
+
+    paging_invalidate_range(directory, virt, done * PAGING_PAGE_SIZE);
+    return res;
+}
+
+/**
+ * Unmaps a range of pages, frames committed by page faults are returned to the frame pool
+ */
+void paging_release(uint32_t* directory, void* virt, size_t size)
+{
+    uint32_t page = (uint32_t)virt / PAGING_PAGE_SIZE;
+    uint32_t total = size / PAGING_PAGE_SIZE;
+    uint32_t done = 0;
+    while (done < total)
+    {
+        uint32_t entry = directory[page / PAGING_TOTAL_ENTRIES_PER_TABLE];
+        uint32_t step = 1;
+        if (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE))
+        {
+            // No table means no committed frames up to the next directory entry
+            step = PAGING_TOTAL_ENTRIES_PER_TABLE - (page % PAGING_TOTAL_ENTRIES_PER_TABLE);
+        }
+        else
+        {
+            uint32_t* table = (uint32_t*)(entry & 0xfffff000);
+            uint32_t old = table[page % PAGING_TOTAL_ENTRIES_PER_TABLE];
+            if ((old & PAGING_IS_PRESENT) && (old & PAGING_IS_RESERVED))
+            {
+                frame_free((void*)(old & 0xfffff000));
+            }
+        }
+
+        page += step;
+        done += step;
+    }
+
+    paging_unmap_range(directory, virt, size);
+}
+
+/**
+ * Gives the faulting address space its own writeable copy of a shared page, the last one to
+ * write keeps the original frame
+ */
+static int paging_copy_on_write(void* page, uint32_t entry)
+{
+    void* frame = (void*)(entry & 0xfffff000);
+    if (frame_refcount(frame) > 1)
+    {
+        void* copy = frame_alloc();
+        if (!copy)
+        {
+            return -ENOMEM;
+        }
+
+        memcpy(copy, frame, PAGING_PAGE_SIZE);
+        frame_free(frame);
+        frame = copy;
+    }
+
+    uint32_t flags = (entry & 0xfff & ~PAGING_IS_COW) | PAGING_IS_WRITEABLE;
+    int res = paging_set(current_directory, page, (uint32_t)frame | flags);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    paging_invalidate(page);
+    return 0;
+}
+
+/**
+ * Commits a frame to a reserved page of the current directory, returns a negative status if the
+ * fault was not caused by touching a reserved page
+ */
+int paging_handle_fault(void* virt, uint32_t error)
+{
+    if (!current_directory)
+    {
+        return -EINVARG;
+    }
+
+    void* page = (void*)((uint32_t)virt & 0xfffff000);
+    uint32_t entry = paging_get(current_directory, page);
+    if (error & PAGING_FAULT_IS_PRESENT)
+    {
+        if ((error & PAGING_FAULT_IS_WRITE) && (entry & PAGING_IS_COW))
+        {
+            return paging_copy_on_write(page, entry);
+        }
+
+        return -EINVARG;
+    }
+
+    if (!(entry & PAGING_IS_RESERVED))
+    {
+        return -EINVARG;
+    }
+
+    void* frame = frame_alloc();
+    if (!frame)
+    {
+        return -ENOMEM;
+    }
+
+    // Frames are identity mapped so the new page can be cleared before it is mapped
+    memset(frame, 0x00, PAGING_PAGE_SIZE);
+    int res = paging_set(current_directory, page, (uint32_t)frame | (entry & 0xfff) | PAGING_IS_PRESENT);
+    if (res < 0)
+    {
+        frame_free(frame);
+        return res;
+    }
+
+    paging_invalidate(page);
+    return 0;
+}
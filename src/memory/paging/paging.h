@@ -5,6 +5,16 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+// Available to the OS, marks a shared page whose frame is copied on the first write
+#define PAGING_IS_COW          0b100000000000
+// Available to the OS, marks a page that belongs to a reserved region and owns its frame once committed
+#define PAGING_IS_RESERVED     0b1000000000
+#define PAGING_IS_GLOBAL       0b100000000
+#define PAGING_IS_LARGE        0b10000000
+// In a 4KB entry bit 7 selects the upper half of the PAT, a 4MB entry uses bit 12 for it
+#define PAGING_PAT             0b10000000
+#define PAGING_LARGE_PAT       0b1000000000000
+#define PAGING_IS_WRITE_COMBINING PAGING_PAT
 #define PAGING_CACHE_DISABLED  0b00010000
 #define PAGING_WRITE_THROUGH   0b00001000
 #define PAGING_ACCESS_FROM_ALL 0b00000100
@@ -12,22 +22,51 @@
 #define PAGING_IS_PRESENT      0b00000001
 
 
+// Memory type written to PAT entry 4
+#define PAGING_PAT_TYPE_WRITE_COMBINING 0x01
+
+// Page fault error code bits
+#define PAGING_FAULT_IS_PRESENT 0b00000001
+#define PAGING_FAULT_IS_WRITE   0b00000010
+
 #define PAGING_TOTAL_ENTRIES_PER_TABLE 1024
 #define PAGING_PAGE_SIZE 4096
+#define PAGING_LARGE_PAGE_SIZE (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE)
 
 
 struct paging_4gb_chunk
 {
     uint32_t* directory_entry;
+
+    // Next address space, kernel directory entries are written to all of them
+    struct paging_4gb_chunk* next;
 };
 
 struct paging_4gb_chunk* paging_new_4gb(uint8_t flags);
+struct paging_4gb_chunk* paging_clone(struct paging_4gb_chunk* chunk);
+void paging_free_4gb(struct paging_4gb_chunk* chunk);
 void paging_switch(uint32_t* directory);
+uint32_t* paging_current_directory();
 void enable_paging();
 
 int paging_set(uint32_t* directory, void* virt, uint32_t val);
+uint32_t paging_get(uint32_t* directory, void* virt);
+void* paging_get_physical_address(uint32_t* directory, void* virt);
+void paging_invalidate(void* virt);
+void paging_invalidate_range(uint32_t* directory, void* virt, size_t size);
+
+int paging_map_range(uint32_t* directory, void* virt, void* phys, size_t size, uint32_t flags);
+int paging_map_write_combining(uint32_t* directory, void* virt, void* phys, size_t size);
+int paging_map_uncached(uint32_t* directory, void* virt, void* phys, size_t size);
+int paging_map_kernel(uint32_t* directory, void* start, void* end);
+void paging_init_pat();
+void paging_unmap_range(uint32_t* directory, void* virt, size_t size);
 bool paging_is_aligned(void* addr);
 
+int paging_reserve(uint32_t* directory, void* virt, size_t size, uint8_t flags);
+void paging_release(uint32_t* directory, void* virt, size_t size);
+int paging_handle_fault(void* virt, uint32_t error);
+
 uint32_t* paging_4gb_chunk_get_directory(struct paging_4gb_chunk* chunk);
 
 #endif
\ No newline at end of file
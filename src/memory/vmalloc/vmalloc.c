@@ -0,0 +1,124 @@
+#include "vmalloc.h"
+#include "config.h"
+#include "kernel.h"
+#include "memory/memory.h"
+#include "memory/heap/heap.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/paging/paging.h"
+#include "cpu/cpu.h"
+
+/**
+ * Virtual address ranges in the vmalloc window are handed out by a struct heap that never
+ * touches the memory it manages, each page of a range is then backed by its own frame.
+ */
+static struct heap vmalloc_heap;
+static struct heap_table vmalloc_heap_table;
+static uint32_t* vmalloc_directory = 0;
+
+// Guards vmalloc_heap and the window's page tables, vmalloc is called from the same places as kmalloc
+static SPINLOCK vmalloc_lock = 0;
+
+void vmalloc_init(uint32_t* directory)
+{
+    size_t total_pages = OS_VMALLOC_SIZE_BYTES / PAGING_PAGE_SIZE;
+    vmalloc_directory = directory;
+
+    // The identity map covers the window too, a stray pointer into it must fault rather than reach
+    // whatever physical memory or device sits at the same address
+    paging_unmap_range(directory, (void*) OS_VMALLOC_START, OS_VMALLOC_SIZE_BYTES);
+
+    vmalloc_heap_table.total = total_pages;
+    vmalloc_heap_table.entries = kmalloc(sizeof(HEAP_BLOCK_TABLE_ENTRY) * total_pages);
+    vmalloc_heap_table.nodes = kmalloc(sizeof(struct heap_free_node) * total_pages);
+    if (!vmalloc_heap_table.entries || !vmalloc_heap_table.nodes)
+    {
+        panic("vmalloc_init: Out of memory\n");
+    }
+
+    void* end = (void*)(OS_VMALLOC_START + OS_VMALLOC_SIZE_BYTES);
+    int res = heap_create(&vmalloc_heap, HEAP_TYPE_TABLE, (void*) OS_VMALLOC_START, end, &vmalloc_heap_table);
+    if (res < 0)
+    {
+        print("Failed to create vmalloc window\n");
+    }
+}
+
+static void vmalloc_unmap_pages(void* ptr, size_t total_pages)
+{
+    for (size_t i = 0; i < total_pages; i++)
+    {
+        void* page = ptr + (i * PAGING_PAGE_SIZE);
+        uint32_t entry = paging_get(vmalloc_directory, page);
+        if (entry & PAGING_IS_PRESENT)
+        {
+            frame_free((void*)(entry & 0xfffff000));
+        }
+
+        paging_set(vmalloc_directory, page, 0);
+    }
+
+    paging_invalidate_range(vmalloc_directory, ptr, total_pages * PAGING_PAGE_SIZE);
+}
+
+void* vmalloc(size_t size)
+{
+    if (!vmalloc_directory || size == 0)
+    {
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&vmalloc_lock);
+    void* ptr = heap_malloc(&vmalloc_heap, size);
+    if (!ptr)
+    {
+        goto out;
+    }
+
+    // The frames backing the range do not need to be next to each other
+    size_t total_pages = heap_allocation_size(&vmalloc_heap, ptr) / PAGING_PAGE_SIZE;
+    for (size_t i = 0; i < total_pages; i++)
+    {
+        void* page = ptr + (i * PAGING_PAGE_SIZE);
+        void* frame = frame_alloc();
+        if (!frame || paging_set(vmalloc_directory, page, (uint32_t) frame | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_IS_GLOBAL) < 0)
+        {
+            if (frame)
+            {
+                frame_free(frame);
+            }
+            vmalloc_unmap_pages(ptr, i);
+            heap_free(&vmalloc_heap, ptr);
+            ptr = 0;
+            goto out;
+        }
+    }
+
+    paging_invalidate_range(vmalloc_directory, ptr, total_pages * PAGING_PAGE_SIZE);
+
+out:
+    spin_unlock_irqrestore(&vmalloc_lock, flags);
+    return ptr;
+}
+
+void* vzalloc(size_t size)
+{
+    void* ptr = vmalloc(size);
+    if (!ptr)
+        return 0;
+
+    memset(ptr, 0x00, size);
+    return ptr;
+}
+
+void vfree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    uint32_t flags = spin_lock_irqsave(&vmalloc_lock);
+    size_t total_pages = heap_allocation_size(&vmalloc_heap, ptr) / PAGING_PAGE_SIZE;
+    vmalloc_unmap_pages(ptr, total_pages);
+    heap_free(&vmalloc_heap, ptr);
+    spin_unlock_irqrestore(&vmalloc_lock, flags);
+}
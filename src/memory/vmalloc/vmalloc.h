@@ -0,0 +1,12 @@
+#ifndef VMALLOC_H
+#define VMALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+void vmalloc_init(uint32_t* directory);
+void* vmalloc(size_t size);
+void* vzalloc(size_t size);
+void vfree(void* ptr);
+
+#endif
@@ -0,0 +1,86 @@
+#include "pci.h"
+#include "io/io.h"
+#include "status.h"
+#include <stdbool.h>
+
+uint32_t pci_config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    uint32_t address = 0x80000000 | (bus << 16) | (slot << 11) | (function << 8) | (offset & 0xfc);
+    outl(PCI_CONFIG_ADDRESS, address);
+    return insl(PCI_CONFIG_DATA);
+}
+
+void pci_config_write(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t val)
+{
+    uint32_t address = 0x80000000 | (bus << 16) | (slot << 11) | (function << 8) | (offset & 0xfc);
+    outl(PCI_CONFIG_ADDRESS, address);
+    outl(PCI_CONFIG_DATA, val);
+}
+
+static bool pci_function_matches(uint8_t bus, uint8_t slot, uint8_t function, uint8_t class_code, uint8_t subclass, struct pci_device* out)
+{
+    uint32_t id = pci_config_read(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+    if ((id & 0xffff) == 0xffff)
+    {
+        return false;
+    }
+
+    uint32_t class = pci_config_read(bus, slot, function, PCI_CONFIG_CLASS);
+    if ((class >> 24) != class_code || ((class >> 16) & 0xff) != subclass)
+    {
+        return false;
+    }
+
+    out->bus = bus;
+    out->slot = slot;
+    out->function = function;
+    out->vendor_id = id & 0xffff;
+    out->device_id = id >> 16;
+    out->class_code = class >> 24;
+    out->subclass = (class >> 16) & 0xff;
+    out->prog_if = (class >> 8) & 0xff;
+    return true;
+}
+
+/**
+ * Scans every bus for the first device of the given class, functions past the first are only
+ * looked at on multi function devices
+ */
+int pci_find_device(uint8_t class_code, uint8_t subclass, struct pci_device* out)
+{
+    for (int bus = 0; bus < PCI_MAX_BUSES; bus++)
+    {
+        for (int slot = 0; slot < PCI_MAX_SLOTS; slot++)
+        {
+            uint32_t id = pci_config_read(bus, slot, 0, PCI_CONFIG_VENDOR_ID);
+            if ((id & 0xffff) == 0xffff)
+            {
+                continue;
+            }
+
+            uint32_t header = pci_config_read(bus, slot, 0, PCI_CONFIG_HEADER_TYPE);
+            int functions = (header & 0x00800000) ? PCI_MAX_FUNCTIONS : 1;
+            for (int function = 0; function < functions; function++)
+            {
+                if (pci_function_matches(bus, slot, function, class_code, subclass, out))
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return -EIO;
+}
+
+uint32_t pci_device_read_bar(struct pci_device* device, int bar)
+{
+    return pci_config_read(device->bus, device->slot, device->function, PCI_CONFIG_BAR0 + (bar * 4));
+}
+
+void pci_device_enable(struct pci_device* device, uint16_t command)
+{
+    uint32_t val = pci_config_read(device->bus, device->slot, device->function, PCI_CONFIG_COMMAND);
+    val |= command;
+    pci_config_write(device->bus, device->slot, device->function, PCI_CONFIG_COMMAND, val);
+}
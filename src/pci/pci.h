@@ -0,0 +1,49 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+#define PCI_MAX_BUSES     256
+#define PCI_MAX_SLOTS     32
+#define PCI_MAX_FUNCTIONS 8
+
+// Offsets into the configuration space header
+#define PCI_CONFIG_VENDOR_ID   0x00
+#define PCI_CONFIG_COMMAND     0x04
+#define PCI_CONFIG_CLASS       0x08
+#define PCI_CONFIG_HEADER_TYPE 0x0C
+#define PCI_CONFIG_BAR0        0x10
+#define PCI_CONFIG_INTERRUPT   0x3C
+
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_BUS_MASTER  0x0004
+
+#define PCI_CLASS_MASS_STORAGE  0x01
+#define PCI_SUBCLASS_IDE        0x01
+#define PCI_SUBCLASS_SATA       0x06
+
+struct pci_device
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+};
+
+uint32_t pci_config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset);
+void pci_config_write(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t val);
+int pci_find_device(uint8_t class_code, uint8_t subclass, struct pci_device* out);
+uint32_t pci_device_read_bar(struct pci_device* device, int bar);
+void pci_device_enable(struct pci_device* device, uint16_t command);
+
+#endif